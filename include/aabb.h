@@ -71,7 +71,7 @@ public:
 
 			if (t0 < t1) {
 				if (t0 > ray_t.min) ray_t.min = t0;
-				if (t1 < ray_t.min) ray_t.max = t1;
+				if (t1 < ray_t.max) ray_t.max = t1;
 			}
 			else {
 				if (t1 > ray_t.min) ray_t.min = t1;
@@ -127,7 +127,7 @@ aabb operator+(const vec3 offset, const aabb& bbox) {
 }
 
 aabb operator*(const aabb& bbox, const vec3& scale) {
-	return aabb(bbox.x + scale.x(), bbox.y + scale.y(), bbox.z + scale.z());
+	return aabb(bbox.x * scale.x(), bbox.y * scale.y(), bbox.z * scale.z());
 }
 
 aabb operator*(const vec3& scale, const aabb& bbox) {
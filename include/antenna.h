@@ -0,0 +1,174 @@
+#ifndef ANTENNA_H
+#define ANTENNA_H
+
+/*
+* Radar antenna gain patterns. A pattern is either analytic, the sinc^2 of a uniformly illuminated
+* rectangular aperture with given half power beamwidths in azimuth and elevation, or tabulated as gain in
+* dB against the angle off boresight. Directions are given as image plane coordinates: the tangents of
+* their azimuth and elevation angles, as a pinhole camera looking along boresight sees them.
+*
+* beam_sampler draws image plane points in proportion to a pattern, so samples concentrate inside the
+* beam instead of spreading evenly over a frustum that is mostly outside it.
+*/
+
+#include "common.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+class antenna_pattern {
+public:
+	/*
+	Parses "sinc:AZ:EL", half power beamwidths in degrees, or "table:<file>", lines of angle off boresight
+	in degrees and gain in dB ('#' starts a comment). Describes the problem in `error` on failure.
+	*/
+	static bool parse(const std::string& spec, antenna_pattern& pattern, std::string& error) {
+		pattern = antenna_pattern();
+		size_t colon = spec.find(':');
+		std::string kind = spec.substr(0, colon);
+		std::string rest = colon == std::string::npos ? "" : spec.substr(colon + 1);
+
+		if (kind == "sinc") {
+			size_t split = rest.find(':');
+			double azimuth = 0.0, elevation = 0.0;
+			if (split == std::string::npos || !parse_double(rest.substr(0, split), azimuth) || !parse_double(rest.substr(split + 1), elevation)
+				|| azimuth <= 0.0 || elevation <= 0.0 || azimuth >= 180.0 || elevation >= 180.0) {
+				error = "antenna expects sinc:<azimuth beamwidth>:<elevation beamwidth> in degrees, got '" + spec + "'";
+				return false;
+			}
+			// sinc^2(x) falls to half power at x = 1.39156
+			pattern.azimuth_scale = 1.39156 / std::sin(degrees_to_radians(azimuth) / 2.0);
+			pattern.elevation_scale = 1.39156 / std::sin(degrees_to_radians(elevation) / 2.0);
+			return true;
+		}
+		if (kind == "table")
+			return pattern.load_table(rest, error);
+
+		error = "antenna expects sinc:AZ:EL or table:<file>, got '" + spec + "'";
+		return false;
+	}
+
+	bool empty() const { return azimuth_scale == 0.0 && angles.empty(); }
+
+	/*One way power gain toward image plane point (x, y), relative to boresight*/
+	double gain(double x, double y) const {
+		if (!angles.empty())
+			return table_gain(std::atan(std::sqrt(x * x + y * y)));
+		return sinc2(azimuth_scale * std::sin(std::atan(x))) * sinc2(elevation_scale * std::sin(std::atan(y)));
+	}
+
+private:
+	double azimuth_scale = 0.0;		// sinc argument per unit sine of the azimuth angle; zero for tables
+	double elevation_scale = 0.0;
+	std::vector<double> angles;		// Tabulated angles off boresight in radians, ascending
+	std::vector<double> gains;		// Linear gain at each angle
+
+	static double sinc2(double x) {
+		if (std::fabs(x) < 1e-8)
+			return 1.0;
+		double s = std::sin(x) / x;
+		return s * s;
+	}
+
+	bool load_table(const std::string& path, std::string& error) {
+		std::ifstream in(path);
+		if (!in) {
+			error = path + ": cannot open antenna pattern";
+			return false;
+		}
+		std::string line;
+		int line_number = 0;
+		while (std::getline(in, line)) {
+			line_number++;
+			std::istringstream words(line.substr(0, line.find('#')));
+			double angle, db;
+			if (!(words >> angle))
+				continue;
+			if (!(words >> db) || angle < 0.0 || (!angles.empty() && degrees_to_radians(angle) <= angles.back())) {
+				error = path + ":" + std::to_string(line_number) + ": expected an ascending angle and a gain in dB";
+				return false;
+			}
+			angles.push_back(degrees_to_radians(angle));
+			gains.push_back(std::pow(10.0, db / 10.0));
+		}
+		if (angles.empty()) {
+			error = path + ": antenna pattern has no entries";
+			return false;
+		}
+		double peak = gains.front();
+		for (double& g : gains)
+			g /= peak;
+		return true;
+	}
+
+	/*Linearly interpolated table gain; angles past the last entry keep its gain*/
+	double table_gain(double angle) const {
+		auto next = std::upper_bound(angles.begin(), angles.end(), angle);
+		if (next == angles.begin())
+			return gains.front();
+		if (next == angles.end())
+			return gains.back();
+		size_t k = size_t(next - angles.begin());
+		double f = (angle - angles[k - 1]) / (angles[k] - angles[k - 1]);
+		return (1.0 - f) * gains[k - 1] + f * gains[k];
+	}
+};
+
+/*
+Samples image plane points (x, y) over [-x_extent, x_extent] x [-y_extent, y_extent] in proportion to a
+weight along each axis, `power` times the pattern's gain along it. A tenth of the samples stay uniform,
+so the pdf is never zero where the full two dimensional pattern is not.
+*/
+class beam_sampler {
+public:
+	beam_sampler() {}
+	beam_sampler(const antenna_pattern& pattern, double power, double x_extent, double y_extent)
+		: x(axis_distribution([&](double t) { return std::pow(pattern.gain(t, 0.0), power); }, x_extent)),
+		y(axis_distribution([&](double t) { return std::pow(pattern.gain(0.0, t), power); }, y_extent)) {}
+
+	/*Draws a point, returning its density relative to uniform sampling over the extent*/
+	double sample(double& px, double& py) const {
+		return x.sample(px) * y.sample(py);
+	}
+
+private:
+	/*Piecewise constant density over [-extent, extent], stored per bin relative to uniform*/
+	struct axis_distribution {
+		static const int bins = 1024;
+		double extent = 1.0;
+		std::vector<double> cdf;		// bins + 1 entries from 0 to 1
+		std::vector<double> density;
+
+		axis_distribution() {}
+
+		template <typename F>
+		axis_distribution(F&& weight, double extent) : extent(extent), cdf(bins + 1, 0.0), density(bins) {
+			double total = 0.0;
+			for (int k = 0; k < bins; k++) {
+				density[k] = weight(extent * (2.0 * (k + 0.5) / bins - 1.0));
+				total += density[k];
+			}
+			for (int k = 0; k < bins; k++) {
+				density[k] = total > 0.0 ? 0.9 * density[k] * bins / total + 0.1 : 1.0;
+				cdf[k + 1] = cdf[k] + density[k] / bins;
+			}
+		}
+
+		double sample(double& t) const {
+			double u = random_double() * cdf.back();
+			int k = int(std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin()) - 1;
+			k = std::clamp(k, 0, bins - 1);
+			double f = (u - cdf[k]) / (cdf[k + 1] - cdf[k]);
+			t = extent * (2.0 * (k + f) / bins - 1.0);
+			return density[k];
+		}
+	};
+
+	axis_distribution x, y;
+};
+
+#endif // ANTENNA_H
@@ -4,6 +4,7 @@
 #include "aabb.h"
 #include "hittable.h"
 #include "hittable_list.h"
+#include "render_stats.h"
 
 #include <algorithm>
 
@@ -44,6 +45,7 @@ public:
 
 
 	bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+		thread_stats.bvh_nodes++;
 		if (!bbox.hit(r, ray_t))
 			return false;
 
@@ -54,6 +56,55 @@ public:
 	}
 
 	aabb bounding_box() const override { return bbox; }
+
+	/*
+	Culls the whole packet by interval arithmetic first, then ray by ray. Once fewer than
+	ray_packet::min_active rays remain they continue alone; otherwise the packet visits the child nearer
+	along its first ray before the other.
+	*/
+	void hit_packet(ray_packet& packet, uint64_t active) const override {
+		thread_stats.bvh_nodes++;
+		if (packet.misses(bbox, active))
+			return;
+
+		uint64_t inside = 0;
+		for (uint64_t m = active; m; m &= m - 1) {
+			int k = std::countr_zero(m);
+			if (bbox.hit(packet.rays[k], interval(packet.t_min, packet.t_max[k])))
+				inside |= uint64_t(1) << k;
+		}
+		if (!inside)
+			return;
+
+		if (std::popcount(inside) < ray_packet::min_active) {
+			hit_record rec;
+			for (uint64_t m = inside; m; m &= m - 1) {
+				int k = std::countr_zero(m);
+				const ray& r = packet.rays[k];
+				bool hit_left = left->hit(r, interval(packet.t_min, packet.t_max[k]), rec);
+				bool hit_right = right->hit(r, interval(packet.t_min, hit_left ? rec.t : packet.t_max[k]), rec);
+				if (hit_left || hit_right) {
+					packet.rec[k] = rec;
+					packet.t_max[k] = rec.t;
+					packet.found[k] = true;
+				}
+			}
+			return;
+		}
+
+		const ray& lead = packet.rays[std::countr_zero(inside)];
+		bool right_first = dot(right->bounding_box().get_center() - left->bounding_box().get_center(), lead.direction()) < 0;
+		const hittable& first = right_first ? *right : *left;
+		const hittable& second = right_first ? *left : *right;
+		first.hit_packet(packet, inside);
+		if (right != left)
+			second.hit_packet(packet, inside);
+	}
+
+	bool triangulate(const placement& place, std::vector<world_triangle>& out) const override {
+		// A single object sits on both sides
+		return left->triangulate(place, out) && (right == left || right->triangulate(place, out));
+	}
 private:
 	shared_ptr<hittable> left;
 	shared_ptr<hittable> right;
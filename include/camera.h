@@ -5,18 +5,39 @@
 * Original code by Peter Shirley (Ray Tracing in a Weekend series)	
 */
 
+#include "antenna.h"
+#include "footprint.h"
 #include "quad.h"
 #include "hittable.h"
 #include "pdf.h"
 #include "material.h"
+#include "parallel.h"
+#include "phase_history.h"
+#include "progress.h"
+#include "range_doppler.h"
+#include "rasterizer.h"
+#include "render_stats.h"
+#include "trace.h"
+#include "transmitter.h"
 
-int tri_hits = 0;
-int quad_hits = 0;
-int tri_aabb_hits = 0;
-int tri_parallel = 0;
-int tri_intersection_behind = 0;
-int tri_barycentric = 0;
-int tri_beyond = 0;
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+/*
+Image projections. Side-looking ones put slant or ground range across the columns (near range left)
+and the flight direction up the rows, as range-Doppler images do, and start their rays close to the
+scene (see camera::fit_projection) instead of at a distant lookfrom.
+*/
+enum PROJECTION {
+    PERSPECTIVE,        // Pinhole through vfov
+    ORTHOGRAPHIC,       // Parallel rays along the look direction, evenly spaced across it
+    GROUND_RANGE        // Rays from the flight line to ground points evenly spaced in ground range
+};
 
 class camera {
 public: 
@@ -30,10 +51,61 @@ public:
     point3 lookfrom             = point3(0, 0, 0);      // Point camera is looking from
     point3 lookat               = point3(0, 0, -1);     // Point camera is looking at
     vec3   vup                  = vec3(0, 1, 0);        // Camera-relative "up" direction
+    PROJECTION projection       = PERSPECTIVE;          // Pinhole or side-looking image, see PROJECTION
+    double look_angle           = 0;                    // Side-looking: look direction off nadir in degrees, 0 to look at lookat
+    double swath_width          = 0;                    // Side-looking: ground width across the image, 0 for vfov's
 
     double defocus_angle        = 0;        // Variation angle of rays through each pixel
     double focus_dist           = 10;       // Distance from camera lookfrom point to plane of perfect focus
 
+    int          threads        = 0;        // Render worker threads, 0 uses one per hardware thread
+    int          tile_size      = 16;       // Width and height of the square tiles handed to workers
+    uint64_t     seed           = 1;        // Base seed, combined with the tile index
+    double       progress_interval = 1.0;   // Seconds between progress reports
+    bool         progress_machine_readable = false;  // Print progress as parseable key=value lines
+
+    std::string cost_map_path;              // If set, per-pixel cost is written to <path>.ppm and <path>.f32
+    std::string output_path;                // Image file to write, stdout when empty
+    SPECTRUM    band            = X;        // Band whose material tables models use, see material_slot
+    bool        multi_band      = false;    // Trace every band along one path and write <output>_<band>.ppm per band
+
+    bool     range_doppler      = false;    // Bin returns by slant range and azimuth instead of forming a perspective image
+    int      range_bins         = 256;      // Range-Doppler image width
+    int      azimuth_bins       = 256;      // Range-Doppler image height
+    interval range_extent;                  // Slant range span of the image, empty to fit the scene
+    interval azimuth_extent;                // Along-track span of the image, empty to fit the scene
+    bool     ground_range       = false;    // Project the range axis onto flat ground at ground_height
+    double   ground_height      = 0;        // Ground plane height for ground_range
+
+    postprocess_pipeline postprocess;       // Stages run on the float image before it is written, see postprocess.h
+    bool     coherent           = false;    // Sum returns as complex amplitudes with path length phase, giving speckle
+    bool     record_phase_history = false;  // Write the pulses' echoes and an image backprojected from them
+
+    int      pulses             = 1;        // Antenna positions along the flight track, all traced in one render
+    double   pulse_spacing      = 1.0;      // Distance flown between pulses, centered on lookfrom
+    point3   track_start        = point3(0, 0, 0);  // Flight track, replacing pulse_spacing when it differs from
+    point3   track_end          = point3(0, 0, 0);  // track_start; lookfrom moves to its midpoint
+    double   squint             = 0;        // Beam angle forward of broadside along the track, degrees
+    bool     pulse_images       = false;    // Write one perspective image per pulse instead of integrating them
+    bool     polarimetric       = false;    // Track the field of every path and image the HH, HV, VH and VV channels
+
+    std::vector<transmitter> transmitters;  // Point transmitters reached by shadow rays; bistatic away from the camera
+    antenna_pattern antenna;                // Gain pattern of the camera's antenna, weighting every sample; see antenna.h
+    int      sbr_rays           = 0;        // Side of each pixel's grid of SBR rays tracing mirror chains, 0 for none
+    int      sbr_bounces        = 4;        // Mirror reflections an SBR ray follows
+    bool     facet_backscatter  = false;    // Preview: an analytic backscatter model at each primary hit instead of path tracing
+
+    bool     rcs_sweep          = false;    // Sweep radar cross section over aspect angles instead of rendering, see rcs.h
+    vec3     rcs_azimuth        = vec3(0, 355, 5);  // First, last and step of the swept azimuths, degrees
+    vec3     rcs_elevation      = vec3(30, 30, 0);  // First, last and step of the swept elevations, degrees
+    int      rcs_rays           = 128;      // Side of each aspect's square grid of plane wave rays
+
+    bool     footprint_cull     = false;    // Build models only where this view's rays can reach, see illuminated_volume
+    double   footprint_margin   = -1;       // Multipath margin around the footprint, negative for a tenth of the world's size
+    bool     raster_primaries   = false;    // Find primary hits with the tiled rasterizer instead of the BVH, see rasterizer.h
+    int      packet_size        = 0;        // Trace primary rays in packets over blocks of this many pixels square, see ray_packet
+    bool     wavefront          = false;    // Advance a tile's paths a bounce at a time, shading hits sorted by material, see render_wavefront
+
     camera() {}
     
     void initialize() {
@@ -44,6 +116,8 @@ public:
         pixel_samples_scale = 1.0 / (sqrt_spp * sqrt_spp);
         recip_sqrt_spp = 1.0 / sqrt_spp;
 
+        if (has_track())
+            lookfrom = (track_start + track_end) / 2.0;
         center = lookfrom;
 
         // Determine viewport dimensions.
@@ -74,41 +148,200 @@ public:
         double defocus_radius = focus_dist * std::tan(degrees_to_radians(defocus_angle / 2.0));
         defocus_disk_u = u * defocus_radius;
         defocus_disk_v = v * defocus_radius;
+
+        if (projection != PERSPECTIVE)
+            initialize_side_looking(theta);
+
+        if (!antenna.empty())
+            beam = beam_sampler(antenna, beam_power(), viewport_width / (2.0 * focus_dist), h);
+
+        // Without an explicit track the radar flies level along the camera's horizontal axis
+        track = sar_track{ center, has_track() ? unit_vector(track_end - track_start) : u };
+
+        // Positive squint turns the beam about vup toward the flight direction
+        double squint_radians = degrees_to_radians(dot(track.direction, u) >= 0 ? -squint : squint);
+        squint_cos = std::cos(squint_radians);
+        squint_sin = std::sin(squint_radians);
+    }
+
+    /*Fills whichever range-Doppler extents are unset so the box's corners fit, with a small margin; set transmitters first*/
+    void fit_range_doppler(const aabb& box) {
+        interval range, azimuth;
+        for (int c = 0; c < 8; c++) {
+            point3 corner((c & 1) ? box.x.max : box.x.min, (c & 2) ? box.y.max : box.y.min, (c & 4) ? box.z.max : box.z.min);
+            range = interval(range, interval(track.range(corner), track.range(corner)));
+            if (pulses > 1) {
+                double to_ends = std::max((corner - pulse_position(0)).length(), (corner - pulse_position(pulses - 1)).length());
+                range = interval(range, interval(to_ends, to_ends));
+            }
+            for (const transmitter& source : transmitters) {
+                double bistatic = (track.range(corner) + (source.position - corner).length()) / 2.0;
+                range = interval(range, interval(bistatic, bistatic));
+            }
+            azimuth = interval(azimuth, interval(track.azimuth(corner), track.azimuth(corner)));
+        }
+        if (range_extent.size() <= 0)
+            range_extent = range.expand(range.size() * 0.05);
+        if (azimuth_extent.size() <= 0)
+            azimuth_extent = azimuth.expand(azimuth.size() * 0.05);
     }
 
 	void render(const hittable& world, const hittable& emitters) {
-		std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
-
-		for (int j = 0; j < image_height; j++) {
-			std::clog << "\rScanlines remaining: " << (image_height - j) << ' ' << std::flush;
-			for (int i = 0; i < image_width; i++) {
-                color pixel_color(0.0, 0.0, 0.0);
-                for (int s_j = 0; s_j < sqrt_spp; s_j++) {
-                    for (int s_i = 0; s_i < sqrt_spp; s_i++) {
-                        ray r = get_ray(i, j, s_i, s_j);
-                        pixel_color += ray_color(r, max_depth, world, emitters);
-                    }
-                }
-				write_color(std::cout, pixel_samples_scale * pixel_color);
-			}
-		}
-        
-		std::clog << "\rDone.                 \n";
-        std::clog << "Triangle hits: " << tri_hits << "\n";
-        std::clog << "Quad hits: " << quad_hits << "\n";
-        std::clog << "Tri bbox hits: " << tri_aabb_hits << "\n";
-        std::clog << "Tri parallel: " << tri_parallel<< "\n";
-        std::clog << "Tri intersection beyond: " << tri_intersection_behind<< "\n";
-        std::clog << "Tri barycentric: " << tri_barycentric<< "\n";
-        std::clog << "Tri beyond: " << tri_beyond << "\n";
-        
+        render_views({ render_view{ this, &world, &emitters } }, threads, progress_machine_readable, progress_interval);
 	}
 
+    /*A camera and the scene it renders, see render_views()*/
+    struct render_view {
+        camera* cam;
+        const hittable* world;
+        const hittable* emitters;
+    };
+
+    /*
+    Renders several views through one shared tile queue so workers move on to the next view's tiles
+    instead of idling at the end of each image. Each view writes its own image and cost map.
+    */
+    static void render_views(const std::vector<render_view>& views, int threads, bool machine_readable, double report_interval) {
+        trace_scope render_span("render", "render");
+
+        int workers = worker_count(threads);
+        std::vector<worker_state> state(workers);
+        std::vector<frame_buffer> frames;
+        std::vector<size_t> first_tile;     // Index of each view's first tile in the shared queue
+        size_t tile_count = 0;
+        uint64_t sample_count = 0;
+        for (const render_view& view : views) {
+            if (view.cam->raster_primaries)
+                view.cam->prepare_raster(*view.world);
+            if (view.cam->wavefront && !view.cam->wavefront_applies())
+                std::clog << "wavefront needs a plain image without a cost map; tracing paths recursively instead\n";
+            frames.push_back(view.cam->make_frame(workers));
+            first_tile.push_back(tile_count);
+            tile_count += view.cam->tile_count();
+            sample_count += uint64_t(view.cam->image_width) * view.cam->image_height * view.cam->sqrt_spp * view.cam->sqrt_spp * view.cam->pulses;
+        }
+
+        progress_reporter progress(tile_count, sample_count, workers, machine_readable, report_interval);
+        progress.start();
+
+        parallel_for(tile_count, threads, [&](size_t job, int worker) {
+            size_t v = size_t(std::upper_bound(first_tile.begin(), first_tile.end(), job) - first_tile.begin()) - 1;
+            const render_view& view = views[v];
+            view.cam->render_tile(job - first_tile[v], *view.world, *view.emitters, frames[v], state[worker], worker, progress);
+        });
+        progress.stop();
+
+        for (size_t v = 0; v < views.size(); v++)
+            views[v].cam->write_frame(frames[v]);
+
+        render_stats totals;
+        for (const worker_state& s : state)
+            totals += s.stats;
+        totals.print(std::clog);
+    }
+
+    /*Constructs a camera ray originatin from the origin and directed at pixel i, j*/
+    ray get_ray(int i, int j, int s_i, int s_j) const {
+        vec3 offset = sample_square_stratified(s_i, s_j);
+        return get_ray_at(i + offset.x(), j + offset.y());
+    }
+
+    /*
+    Lets side-looking rays start just outside the bounding sphere of `box`, the world, rather than back at
+    the flight line, which keeps their origins small next to the scene's coordinates.
+    */
+    void fit_projection(const aabb& box) {
+        scene_center = box.get_center();
+        scene_radius = 0.5 * vec3(box.x.size(), box.y.size(), box.z.size()).length();
+    }
+
+    /*Camera ray through the continuous pixel coordinates x, y*/
+    ray get_ray_at(double x, double y) const {
+        if (projection != PERSPECTIVE)
+            return side_looking_ray(x, y);
+
+        point3 pixel_sample = pixel00_loc + (x * pixel_delta_u) + (y * pixel_delta_v);
+
+        point3 ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample();
+        vec3 ray_direction = pixel_sample - ray_origin;
+        double ray_time = random_double();
+
+        return ray(ray_origin, ray_direction, ray_time);
+    }
+
+    int height() const { return image_height; }
+    bool has_track() const { return (track_end - track_start).length_squared() > 0; }
+
+    /*Antenna position of pulse p: evenly spaced from track_start to track_end, or pulse_spacing apart around lookfrom*/
+    point3 pulse_position(int p) const {
+        if (has_track())
+            return track_start + (pulses == 1 ? 0.5 : p / (pulses - 1.0)) * (track_end - track_start);
+        return center + (p - (pulses - 1) / 2.0) * pulse_spacing * u;
+    }
+
+    /*get_ray from pulse p's antenna position, with the beam squinted*/
+    ray pulse_ray(int i, int j, int s_i, int s_j, int p) const {
+        return pulse_ray(get_ray(i, j, s_i, s_j), p);
+    }
+
+    /*Moves camera ray r to pulse p's antenna position and squints it, then lets side-looking rays start near the scene*/
+    ray pulse_ray(const ray& r, int p) const {
+        if (pulses == 1 && squint == 0)
+            return near_scene(r);
+        return near_scene(squinted_ray(r, p));
+    }
+
+    /*
+    Half-spaces bounding every ray the camera traces, from any pulse, before side-looking rays are moved
+    forward: one per image edge, the plane its rays sweep moved out to the furthest pulse, and one behind
+    the antennas. Image plane tangents past the image edges never carry samples, so antenna patterns
+    need no planes of their own.
+    */
+    std::vector<half_space> illuminated_volume() const {
+        const double corners[4][2] = { { -0.5, -0.5 }, { image_width - 0.5, -0.5 }, { image_width - 0.5, image_height - 0.5 }, { -0.5, image_height - 0.5 } };
+        ray edge[4];
+        for (int k = 0; k < 4; k++) {
+            edge[k] = squinted_ray(get_ray_at(corners[k][0], corners[k][1]), 0);
+            edge[k] = ray(edge[k].origin(), unit_vector(edge[k].direction()), 0.0);
+        }
+        ray middle = squinted_ray(get_ray_at((image_width - 1) / 2.0, (image_height - 1) / 2.0), 0);
+        point3 inside = middle.at(1.0);
+        vec3 travel = pulse_position(pulses - 1) - pulse_position(0);
+        double aperture = 2.0 * focus_dist * std::tan(degrees_to_radians(std::max(defocus_angle, 0.0) / 2.0));   // Jittered origins and their spread
+
+        std::vector<half_space> volume;
+        auto add = [&](vec3 normal, const point3& through) {
+            if (normal.length_squared() < 1e-24)
+                return;
+            normal = unit_vector(normal);
+            if (dot(normal, inside - through) > 0)
+                normal = -normal;
+            volume.push_back({ normal, dot(normal, through) + std::max(0.0, dot(normal, travel)) + aperture });
+        };
+        for (int k = 0; k < 4; k++) {
+            const ray& a = edge[k];
+            const ray& b = edge[(k + 1) % 4];
+            vec3 step = b.origin() - a.origin();
+            bool shared_origin = projection == PERSPECTIVE || step.length_squared() <= 1e-18 * a.origin().length_squared();
+            add(shared_origin ? cross(a.direction(), b.direction()) : cross(a.direction(), step), a.origin());
+        }
+        vec3 back = -unit_vector(middle.direction());
+        point3 furthest = edge[0].origin();
+        for (int k = 1; k < 4; k++)
+            if (dot(back, edge[k].origin()) > dot(back, furthest))
+                furthest = edge[k].origin();
+        add(back, furthest);
+        return volume;
+    }
+    int samples_per_axis() const { return sqrt_spp; }
+
+    /*Adds an emitter just behind the camera to the world, and the same quad to the lights that are sampled*/
     void colocate_light(hittable_list& world, hittable_list& lights, const shared_ptr<material>& light) {
         vec3 offset = (lookat - lookfrom) * 0.01;
+        point3 corner = center + (viewport_u * 100.0 / 2.0) + (viewport_v * 100.0 / 2.0) - offset;
 
-        world.add(make_shared<quad>(center + (viewport_u * 100.0 / 2.0) + (viewport_v * 100.0 / 2.0) - offset, -viewport_u * 100.0, -viewport_v * 100.0, light));
-        lights.add(make_shared<quad>(center + (viewport_u * 100.0 / 2.0) + (viewport_u * 100.0 / 2.0), viewport_u * 100, viewport_v * 100, shared_ptr<material>()));
+        world.add(make_shared<quad>(corner, -viewport_u * 100.0, -viewport_v * 100.0, light));
+        lights.add(make_shared<quad>(corner, -viewport_u * 100.0, -viewport_v * 100.0, shared_ptr<material>()));
     }
 private:
     int    image_height;            // Rendered image height
@@ -125,19 +358,1247 @@ private:
     vec3   u, v, w;                 // Camera frame basis vectors
     vec3   defocus_disk_u;          // Defocus disk horizontal radius
     vec3   defocus_disk_v;          // Defocus disk vertical radius
+    sar_track track;                // Flight line for range-Doppler images
+    beam_sampler beam;              // Draws range-Doppler and phase history samples from the antenna pattern
+    double squint_cos = 1, squint_sin = 0;
+    vec3   look;                    // Side-looking: unit look direction
+    vec3   across;                  // Side-looking: unit far range direction, in the image plane or on the ground
+    point3 swath_center;            // Side-looking: where the look direction from lookfrom meets the ground
+    double swath_pixel = 0;         // Side-looking: pixel spacing, in the image plane or on the ground
+    point3 scene_center;            // Bounding sphere side-looking rays start outside, see fit_projection
+    double scene_radius = -1;       // Negative until fit_projection
+    shared_ptr<rasterizer> raster;  // Primary visibility when raster_primaries applies, see prepare_raster
 
-    /*Constructs a camera ray originatin from the origin and directed at pixel i, j*/
-    ray get_ray(int i, int j, int s_i, int s_j) const {
-        vec3 offset = sample_square_stratified(s_i, s_j);
-        point3 pixel_sample = pixel00_loc
-            + ((i + offset.x()) * pixel_delta_u)
-            + ((j + offset.y()) * pixel_delta_v);
+    /*
+    Frame of the side-looking projections. u stays the flight direction; the look direction is the one
+    from lookfrom to lookat, or look_angle off nadir toward lookat's side when set. Without a swath_width,
+    the swath is what a vfov tall image of the same aspect ratio would span across range at the ground.
+    */
+    void initialize_side_looking(double theta) {
+        vec3 up = unit_vector(vup);
+        vec3 side = unit_vector(cross(up, u));
+        if (look_angle > 0) {
+            double a = degrees_to_radians(look_angle);
+            look = unit_vector(-std::cos(a) * up + std::sin(a) * side);
+            w = -look;
+            v = cross(w, u);
+            viewport_v = viewport_v.length() * -v;
+        }
+        else {
+            look = -w;
+        }
 
-        point3 ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample();
-        vec3 ray_direction = pixel_sample - ray_origin;
+        // Flat ground at ground_height; a look direction that never meets it aims at lookat
+        double down = -dot(look, up);
+        double height = height_above_ground(lookfrom);
+        double slant = down > 1e-6 && height > 0 ? height / down : (lookat - lookfrom).length();
+        swath_center = lookfrom + slant * look;
+
+        double cos_incidence = std::max(down, 1e-6);
+        double swath = swath_width > 0 ? swath_width
+            : 2.0 * std::tan(theta / 2.0) * slant * (double(image_width) / image_height) / cos_incidence;
+        if (projection == ORTHOGRAPHIC) {
+            across = v;
+            swath_pixel = swath * cos_incidence / image_width;
+        }
+        else {
+            across = side;
+            swath_pixel = swath / image_width;
+        }
+    }
+
+    /*
+    Side-looking ray through the continuous pixel coordinates x, y, from the flight line: parallel to the
+    look direction for ORTHOGRAPHIC, and toward the ground point at its ground range for GROUND_RANGE
+    */
+    ray side_looking_ray(double x, double y) const {
+        double range_offset = (x + 0.5 - image_width / 2.0) * swath_pixel;
+        double along_offset = (image_height / 2.0 - y - 0.5) * swath_pixel;
         double ray_time = random_double();
 
-        return ray(ray_origin, ray_direction, ray_time);
+        point3 target = swath_center + range_offset * across + along_offset * u;
+        if (projection == ORTHOGRAPHIC)
+            return ray(target - (swath_center - lookfrom).length() * look, look, ray_time);
+        point3 origin = lookfrom + along_offset * u;
+        return ray(origin, unit_vector(target - origin), ray_time);
+    }
+
+    /*Camera ray r moved to pulse p's antenna position and squinted*/
+    ray squinted_ray(const ray& r, int p) const {
+        vec3 d = r.direction();
+        vec3 axis = unit_vector(vup);
+        vec3 squinted = d * squint_cos + cross(axis, d) * squint_sin + axis * dot(axis, d) * (1 - squint_cos);
+        return ray(r.origin() + (pulse_position(p) - center), squinted, r.time());
+    }
+
+    /*Side-looking ray r moved forward along itself to just outside the scene's bounding sphere; others unchanged*/
+    ray near_scene(const ray& r) const {
+        if (projection == PERSPECTIVE || scene_radius < 0)
+            return r;
+        double t = dot(scene_center - r.origin(), r.direction()) - 1.01 * scene_radius;
+        return t > 0 ? ray(r.origin() + t * r.direction(), r.direction(), r.time()) : r;
+    }
+
+    /*
+    Projects and bins the world for raster_primaries. Only plain images from a single pinhole or
+    orthographic antenna position qualify; anything else keeps tracing its primary rays.
+    */
+    void prepare_raster(const hittable& world) {
+        trace_scope raster_span("raster_setup", "build");
+        raster.reset();
+        if (!plain_image() || pulses > 1 || squint != 0 || defocus_angle > 0 || projection == GROUND_RANGE) {
+            std::clog << "raster_primaries needs a single pulse, plain image from a pinhole or orthographic camera; tracing primaries instead\n";
+            return;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        raster_view view;
+        view.width = image_width;
+        view.height = image_height;
+        view.tile_size = tile_size;
+        if (projection == PERSPECTIVE) {
+            view.origin = center;
+            view.forward = -w;
+            view.focus = focus_dist;
+            view.pixel00 = pixel00_loc;
+            view.delta_u = pixel_delta_u;
+            view.delta_v = pixel_delta_v;
+        }
+        else {
+            view.orthographic = true;
+            view.origin = swath_center;
+            view.forward = look;
+            view.delta_u = swath_pixel * across;
+            view.delta_v = -swath_pixel * u;
+            view.pixel00 = swath_center + (0.5 - image_width / 2.0) * view.delta_u - (image_height / 2.0 - 0.5) * view.delta_v;
+        }
+        raster = make_shared<rasterizer>(world, view, threads);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::clog << "Rasterizing primaries: " << raster->triangle_count() << " triangles (" << raster->clipped_count()
+            << " clipped by the camera plane), " << raster->traced_count() << " objects ray traced, set up in " << seconds << " s\n";
+    }
+
+    /*Whether pixels are plain images that render_pixel fills, rather than radar returns or bands*/
+    bool plain_image() const {
+        return !range_doppler && !record_phase_history && !coherent && !polarimetric && !facet_backscatter && !multi_band;
+    }
+
+    /*Whether render_tile uses render_wavefront: plain images without a cost map, which it does not record*/
+    bool wavefront_applies() const {
+        return plain_image() && cost_map_path.empty();
+    }
+
+    /*A primary ray found ahead of render_pixel, with its weight and first hit*/
+    struct primary_sample {
+        ray r;
+        double weight = 1.0;
+        bool found = false;
+        hit_record rec;
+    };
+
+    /*Primary samples of the tile's pixels from pulse p, drawn as beam_ray would and resolved by the rasterizer*/
+    std::vector<primary_sample> raster_tile(int x0, int y0, int x1, int y1, int p) const {
+        std::vector<raster_sample> samples(size_t(x1 - x0) * (y1 - y0) * sqrt_spp * sqrt_spp);
+        size_t n = 0;
+        for (int j = y0; j < y1; j++)
+            for (int i = x0; i < x1; i++)
+                for (int s_j = 0; s_j < sqrt_spp; s_j++)
+                    for (int s_i = 0; s_i < sqrt_spp; s_i++, n++)
+                        samples[n].r = beam_ray(i, j, s_i, s_j, p, samples[n].weight);
+        raster->resolve(x0, y0, x1, y1, sqrt_spp * sqrt_spp, samples);
+
+        std::vector<primary_sample> primaries(samples.size());
+        for (size_t k = 0; k < samples.size(); k++) {
+            primaries[k].r = samples[k].r;
+            primaries[k].weight = samples[k].weight;
+            primaries[k].found = max_depth > 0 && raster->hit(samples[k], primaries[k].rec);
+        }
+        return primaries;
+    }
+
+    /*
+    Primary samples of the tile's pixels from pulse p on, drawn as beam_ray would. The same sample of every
+    pixel in a block packet_size pixels square makes one packet, traced through the world at once.
+    */
+    std::vector<primary_sample> packet_tile(const hittable& world, int x0, int y0, int x1, int y1, int p) const {
+        int per_pixel = pixel_pulses() * sqrt_spp * sqrt_spp;
+        std::vector<primary_sample> samples(size_t(x1 - x0) * (y1 - y0) * per_pixel);
+        size_t n = 0;
+        for (int j = y0; j < y1; j++)
+            for (int i = x0; i < x1; i++)
+                for (int k = p; k < p + pixel_pulses(); k++)
+                    for (int s_j = 0; s_j < sqrt_spp; s_j++)
+                        for (int s_i = 0; s_i < sqrt_spp; s_i++, n++)
+                            samples[n].r = beam_ray(i, j, s_i, s_j, k, samples[n].weight);
+        if (max_depth <= 0)
+            return samples;
+
+        auto packet = std::make_unique<ray_packet>();
+        std::vector<size_t> members;
+        for (int by = y0; by < y1; by += packet_size) {
+            for (int bx = x0; bx < x1; bx += packet_size) {
+                for (int s = 0; s < per_pixel; s++) {
+                    packet->size = 0;
+                    members.clear();
+                    for (int j = by; j < std::min(by + packet_size, y1); j++) {
+                        for (int i = bx; i < std::min(bx + packet_size, x1); i++) {
+                            members.push_back((size_t(j - y0) * (x1 - x0) + (i - x0)) * per_pixel + s);
+                            packet->add(samples[members.back()].r);
+                        }
+                    }
+                    packet->bound(packet->all());
+                    world.hit_packet(*packet, packet->all());
+                    thread_stats.rays += packet->size;
+                    for (int m = 0; m < packet->size; m++) {
+                        samples[members[m]].found = packet->found[m];
+                        if (packet->found[m])
+                            samples[members[m]].rec = packet->rec[m];
+                    }
+                }
+            }
+        }
+        return samples;
+    }
+
+    /*Image being rendered, filled tile by tile*/
+    struct frame_buffer {
+        std::vector<color> pixels;
+        cost_map costs;
+        std::vector<range_doppler_grid> returns;    // Range-Doppler grids, one per worker and band
+        std::vector<phase_history> echoes;          // Phase histories, one per worker and band
+        complex_buffer field;                       // Coherent perspective image, in the planes of pixels
+    };
+
+    /*A path of the wavefront integrator: its next ray, the weight of what it finds and the pixel it adds to*/
+    struct wavefront_path {
+        ray r;
+        color throughput;
+        size_t pixel;       // Index into the batch's pixels
+        int depth;
+    };
+
+    /*The hits on one material during a bounce of the wavefront integrator*/
+    struct wavefront_bucket {
+        const std::type_info* type;
+        const material* mat;    // Resolved, so hits through material slots group with what they show
+        size_t count;
+        size_t next;        // Where the bucket's next hit goes in the shading order
+    };
+
+    /*A worker's wavefront queues, kept from tile to tile so their memory is reused*/
+    struct wavefront_queues {
+        std::vector<wavefront_path> paths, next;
+        std::vector<hit_record> records;    // Parallel to paths, never shrunk
+        std::vector<size_t> bucket;         // Parallel to paths: the bucket of each hit
+        std::vector<wavefront_bucket> buckets;
+        std::unordered_map<const material*, size_t> bucket_of;
+        std::vector<size_t> ranked;         // Buckets by material type, then instance
+        std::vector<size_t> order;          // The paths that hit, in shading order
+        std::vector<color> radiance;        // Per pixel of the batch
+        scatter_record srec;                // Reused from hit to hit, and so is the lobe pdf it holds
+    };
+
+    /*Counters a render worker accumulates across tiles*/
+    struct worker_state {
+        render_stats stats;
+        double busy_seconds = 0.0;
+        uint64_t samples = 0;
+        wavefront_queues queues;
+    };
+
+    frame_buffer make_frame(int workers) const {
+        frame_buffer frame;
+        if (range_doppler || record_phase_history) {
+            if (range_extent.size() <= 0 || azimuth_extent.size() <= 0) {
+                std::cerr << "Range-Doppler image needs a range and azimuth extent, see fit_range_doppler()" << std::endl;
+                exit(-1);
+            }
+        }
+        if (record_phase_history) {
+            for (int w = 0; w < workers; w++)
+                for (int c = 0; c < frame_channels(); c++)
+                    frame.echoes.push_back(phase_history(pulses, range_bins, range_extent, SPECTRAL_MAP.find(frame_band(c / frame_pols()))->second));
+        }
+        else if (range_doppler) {
+            frame.returns.assign(size_t(workers) * frame_channels(), range_doppler_grid(range_bins, azimuth_bins, range_extent, azimuth_extent, coherent));
+        }
+        else if (coherent) {
+            frame.field = complex_buffer(size_t(image_width) * image_height * frame_planes());
+        }
+        else {
+            frame.pixels.resize(size_t(image_width) * image_height * frame_planes());
+        }
+        if (!cost_map_path.empty())
+            frame.costs = cost_map(image_width, image_height);
+        return frame;
+    }
+
+    int frame_bands() const { return multi_band ? BAND_COUNT : 1; }
+
+    /*The band stored in plane b of a frame*/
+    SPECTRUM frame_band(int b) const { return multi_band ? SPECTRUM(b) : band; }
+
+    int frame_pols() const { return polarimetric ? POL_COUNT : 1; }
+
+    /*Channels of every image: the bands, each split into polarizations when polarimetric*/
+    int frame_channels() const { return frame_bands() * frame_pols(); }
+
+    /*Perspective image planes: one per channel, times one per pulse with pulse_images*/
+    int frame_planes() const { return frame_channels() * (pulse_images ? pulses : 1); }
+
+    /*
+    Pulses traced each time a pixel is visited. An integrated perspective image averages every pulse into
+    its pixels, so each tile traces them all; everything else visits the tiles once per pulse.
+    */
+    int pixel_pulses() const { return range_doppler || record_phase_history || pulse_images ? 1 : pulses; }
+
+    int tiles_x() const { return (image_width + tile_size - 1) / tile_size; }
+
+    size_t image_tiles() const { return size_t(tiles_x()) * ((image_height + tile_size - 1) / tile_size); }
+
+    /*The image's tiles, repeated pulse after pulse unless every pixel integrates all pulses*/
+    size_t tile_count() const { return image_tiles() * (pulses / pixel_pulses()); }
+
+    void render_tile(size_t tile, const hittable& world, const hittable& emitters, frame_buffer& frame, worker_state& worker, int worker_index, progress_reporter& progress) {
+        int pulse = int(tile / image_tiles());      // Zero when pixels integrate every pulse
+        int x0 = int(tile % image_tiles() % tiles_x()) * tile_size;
+        int y0 = int(tile % image_tiles() / tiles_x()) * tile_size;
+        trace_scope tile_span("tile", "render", trace_recorder::get().is_enabled() ? std::to_string(x0) + "," + std::to_string(y0) : std::string());
+
+        // Seeding per tile keeps the image independent of the thread count and scheduling order
+        seed_random(seed * 0x9E3779B97F4A7C15ull + tile);
+        shading_band = multi_band ? BAND_COUNT : band;
+        render_stats before = thread_stats;
+        int x1 = std::min(x0 + tile_size, image_width), y1 = std::min(y0 + tile_size, image_height);
+        std::vector<primary_sample> primaries;
+        if (raster)
+            primaries = raster_tile(x0, y0, x1, y1, pulse);
+        else if (packet_size > 0 && plain_image())
+            primaries = packet_tile(world, x0, y0, x1, y1, pulse);
+
+        if (wavefront && wavefront_applies()) {
+            auto start = std::chrono::steady_clock::now();
+            render_wavefront(x0, y0, x1, y1, pulse, world, emitters, primaries, worker.queues, &frame.pixels[plane(pulse, 0)]);
+            worker.busy_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            worker.samples += uint64_t(x1 - x0) * (y1 - y0) * sqrt_spp * sqrt_spp * pixel_pulses();
+            progress.update(worker_index, worker.samples, worker.stats.rays + thread_stats.rays - before.rays, worker.busy_seconds);
+        }
+        else {
+            for (int j = y0; j < y1; j++) {
+                for (int i = x0; i < x1; i++) {
+                    auto start = std::chrono::steady_clock::now();
+                    if (record_phase_history)
+                        render_pixel_echoes(i, j, pulse, world, emitters, frame, worker_index);
+                    else if (range_doppler)
+                        render_pixel_returns(i, j, pulse, world, emitters, frame, worker_index);
+                    else if (coherent || polarimetric || facet_backscatter)
+                        render_pixel_channels(i, j, pulse, world, emitters, frame);
+                    else if (multi_band)
+                        render_pixel_bands(i, j, pulse, world, emitters, frame);
+                    else
+                        frame.pixels[plane(pulse, 0) + size_t(j) * image_width + i] = render_pixel(i, j, pulse, world, emitters, frame.costs,
+                            primaries.empty() ? nullptr : &primaries[(size_t(j - y0) * (x1 - x0) + (i - x0)) * pixel_pulses() * sqrt_spp * sqrt_spp]);
+
+                    worker.busy_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                    worker.samples += sqrt_spp * sqrt_spp * pixel_pulses();
+                    progress.update(worker_index, worker.samples, worker.stats.rays + thread_stats.rays - before.rays, worker.busy_seconds);
+                }
+            }
+        }
+
+        worker.stats += thread_stats - before;
+        progress.tile_done();
+    }
+
+    void write_frame(const frame_buffer& frame) const {
+        if (record_phase_history) {
+            write_phase_history(frame);
+            return;
+        }
+        if (range_doppler) {
+            write_range_doppler(frame);
+            return;
+        }
+
+        size_t pixel_count = size_t(image_width) * image_height;
+        for (int n = 0; n < frame_planes(); n++) {
+            int c = n % frame_channels();
+            std::string path = output_path;
+            if (multi_band || pulse_images || polarimetric) {
+                std::string stem = output_path.empty() ? "image" : output_path.substr(0, output_path.rfind(".ppm"));
+                path = stem + (pulse_images ? "_pulse" + std::to_string(n / frame_channels()) : "") + channel_suffix(c) + ".ppm";
+            }
+
+            // Post-processed images are intensity: the detected power, or the mean of the color channels
+            if (!postprocess.empty()) {
+                intensity_image intensity(image_width, image_height);
+                for (size_t p = 0; p < pixel_count; p++)
+                    intensity.data[p] = float(coherent ? frame.field.power(n * pixel_count + p) : average(frame.pixels[n * pixel_count + p]));
+                std::string prefix = path.empty() ? "image" : path.substr(0, path.rfind(".ppm"));
+                write_intensity(prefix, postprocess.run(intensity, threads), postprocess.output_scale());
+                std::clog << "Wrote " << prefix << ".ppm and " << prefix << ".f32\n";
+                continue;
+            }
+
+            std::ofstream file;
+            if (!path.empty()) {
+                file.open(path);
+                if (!file) {
+                    std::cerr << "Cannot write image " << path << std::endl;
+                    exit(-1);
+                }
+            }
+            std::ostream& image = path.empty() ? std::cout : file;
+            image << "P3\n" << image_width << ' ' << image_height << "\n255\n";
+            for (size_t p = n * pixel_count; p < (n + 1) * pixel_count; p++) {
+                if (coherent) {
+                    double power = frame.field.power(p);
+                    write_color(image, color(power, power, power));
+                }
+                else {
+                    write_color(image, frame.pixels[p]);
+                }
+            }
+            if (multi_band || pulse_images || polarimetric)
+                std::clog << "Wrote " << path << "\n";
+        }
+
+        if (!frame.costs.empty())
+            frame.costs.write(cost_map_path);
+    }
+
+    /*Offset of the frame plane holding channel c of pulse p's image*/
+    size_t plane(int p, int c) const { return size_t(pulse_images ? p * frame_channels() + c : c) * image_width * image_height; }
+
+    /*File name suffix of channel c: its band when multi_band, then its polarization when polarimetric*/
+    std::string channel_suffix(int c) const {
+        return (multi_band ? std::string("_") + band_name(SPECTRUM(c / frame_pols())) : std::string())
+            + (polarimetric ? std::string("_") + pol_name(c % frame_pols()) : std::string());
+    }
+
+    /*
+    Averages all subpixel samples of pixel i, j from pulse p, or from every pulse when pixels integrate
+    them, recording its cost if a cost map is being built. With `primaries`, the pixel's samples already
+    rasterized or traced in packets, paths start from their hits instead.
+    */
+    color render_pixel(int i, int j, int p, const hittable& world, const hittable& emitters, cost_map& costs, const primary_sample* primaries = nullptr) {
+        render_stats before = thread_stats;
+        auto start = std::chrono::steady_clock::now();
+
+        color pixel_color(0.0, 0.0, 0.0);
+        for (int k = p; k < p + pixel_pulses(); k++) {
+            for (int s_j = 0; s_j < sqrt_spp; s_j++) {
+                for (int s_i = 0; s_i < sqrt_spp; s_i++) {
+                    if (primaries) {
+                        const primary_sample& sample = primaries[((k - p) * sqrt_spp + s_j) * sqrt_spp + s_i];
+                        color sample_color = max_depth <= 0 ? color(0, 0, 0)
+                            : sample.found ? shade(sample.r, sample.rec, max_depth, world, emitters) : background;
+                        pixel_color += sample.weight * sample_color;
+                        continue;
+                    }
+                    double weight;
+                    ray r = beam_ray(i, j, s_i, s_j, k, weight);
+                    pixel_color += weight * ray_color(r, max_depth, world, emitters);
+                }
+            }
+        }
+
+        if (!costs.empty() && p == 0) {
+            std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            costs.record(i, j, thread_stats.bvh_nodes - before.bvh_nodes, thread_stats.prim_tests - before.prim_tests, elapsed.count());
+        }
+        return (pixel_samples_scale / pixel_pulses()) * pixel_color;
+    }
+
+    /*
+    render_pixel for every pixel of the tile at once, into `pixels` laid out as the frame's planes. The
+    tile's paths advance a bounce at a time, in batches of up to wavefront_batch: every path is extended
+    to its next hit, the hits are sorted by the type and instance of the material they show, looking
+    through material slots, and each material's hits are shaded together by shade_bucket. The rays they
+    scatter make the next batch. Paths carry the weight of everything before them rather than recursing as ray_color does,
+    which gives the same estimate.
+    */
+    void render_wavefront(int x0, int y0, int x1, int y1, int p, const hittable& world, const hittable& emitters,
+        const std::vector<primary_sample>& primaries, wavefront_queues& q, color* pixels) {
+        const size_t wavefront_batch = 1 << 16;
+        int width = x1 - x0;
+        size_t tile_pixels = size_t(width) * (y1 - y0);
+        int per_pixel = pixel_pulses() * sqrt_spp * sqrt_spp;
+        size_t batch_pixels = std::max<size_t>(1, wavefront_batch / per_pixel);
+
+        for (size_t first = 0; first < tile_pixels; first += batch_pixels) {
+            size_t last = std::min(tile_pixels, first + batch_pixels);
+            q.radiance.assign(last - first, color(0, 0, 0));
+            q.paths.clear();
+            if (max_depth > 0) {
+                for (size_t n = first; n < last; n++) {
+                    int i = x0 + int(n % width), j = y0 + int(n / width);
+                    for (int k = p; k < p + pixel_pulses(); k++) {
+                        for (int s_j = 0; s_j < sqrt_spp; s_j++) {
+                            for (int s_i = 0; s_i < sqrt_spp; s_i++) {
+                                double weight = 1.0;
+                                ray r = primaries.empty() ? beam_ray(i, j, s_i, s_j, k, weight) : ray();
+                                q.paths.push_back({ r, color(weight, weight, weight), n - first, max_depth });
+                            }
+                        }
+                    }
+                }
+            }
+
+            for (bool primary = true; !q.paths.empty(); primary = false) {
+                // Extend: every path to its next hit; misses pick up the background
+                if (q.records.size() < q.paths.size())
+                    q.records.resize(q.paths.size());
+                q.bucket.resize(q.paths.size());
+                q.buckets.clear();
+                q.bucket_of.clear();
+                const material* last = nullptr;
+                size_t last_bucket = 0;
+                for (size_t k = 0; k < q.paths.size(); k++) {
+                    wavefront_path& path = q.paths[k];
+                    bool found;
+                    if (primary && !primaries.empty()) {
+                        const primary_sample& sample = primaries[first * per_pixel + k];
+                        path.r = sample.r;
+                        path.throughput = color(sample.weight, sample.weight, sample.weight);
+                        found = sample.found;
+                        if (found)
+                            q.records[k] = sample.rec;
+                    }
+                    else {
+                        thread_stats.rays++;
+                        found = world.hit(path.r, interval(0.001, infinity), q.records[k]);
+                    }
+                    if (!found) {
+                        q.radiance[path.pixel] += path.throughput * background;
+                        q.bucket[k] = q.paths.size();
+                        continue;
+                    }
+                    // Neighboring paths mostly hit the same material, so the last bucket saves most lookups
+                    const material* mat = q.records[k].mat.get();
+                    if (mat != last) {
+                        const material* shown = mat->resolve();
+                        auto [slot, added] = q.bucket_of.try_emplace(shown, q.buckets.size());
+                        if (added)
+                            q.buckets.push_back({ &typeid(*shown), shown, 0, 0 });
+                        last = mat;
+                        last_bucket = slot->second;
+                    }
+                    q.buckets[last_bucket].count++;
+                    q.bucket[k] = last_bucket;
+                }
+
+                // Sort the hits by material: a counting sort over the buckets, ranked by type and instance
+                q.ranked.resize(q.buckets.size());
+                for (size_t b = 0; b < q.buckets.size(); b++)
+                    q.ranked[b] = b;
+                std::sort(q.ranked.begin(), q.ranked.end(), [&](size_t a, size_t b) {
+                    const wavefront_bucket& x = q.buckets[a], & y = q.buckets[b];
+                    return x.type != y.type ? std::less<const std::type_info*>()(x.type, y.type) : std::less<const material*>()(x.mat, y.mat);
+                });
+                size_t hits = 0;
+                for (size_t b : q.ranked) {
+                    q.buckets[b].next = hits;
+                    hits += q.buckets[b].count;
+                }
+                q.order.resize(hits);
+                for (size_t k = 0; k < q.paths.size(); k++)
+                    if (q.bucket[k] < q.paths.size())
+                        q.order[q.buckets[q.bucket[k]].next++] = k;
+
+                // Shade bucket after bucket, queueing the rays they scatter
+                q.next.clear();
+                for (size_t b : q.ranked) {
+                    const wavefront_bucket& bucket = q.buckets[b];
+                    shade_bucket(bucket, &q.order[bucket.next - bucket.count], world, emitters, q);
+                }
+                std::swap(q.paths, q.next);
+            }
+
+            double scale = pixel_samples_scale / pixel_pulses();
+            for (size_t n = first; n < last; n++)
+                pixels[size_t(y0 + int(n / width)) * image_width + x0 + int(n % width)] = scale * q.radiance[n - first];
+        }
+    }
+
+    /*
+    shade_hits for one bucket of render_wavefront, picking the material's type once for the whole bucket.
+    The types scenes build are named here so their calls bind statically; any other goes through material.
+    */
+    void shade_bucket(const wavefront_bucket& bucket, const size_t* hits, const hittable& world, const hittable& emitters, wavefront_queues& q) {
+        const std::type_info& type = *bucket.type;
+        if (type == typeid(lambertian))
+            shade_hits(static_cast<const lambertian&>(*bucket.mat), hits, bucket.count, world, emitters, q);
+        else if (type == typeid(metal))
+            shade_hits(static_cast<const metal&>(*bucket.mat), hits, bucket.count, world, emitters, q);
+        else if (type == typeid(medium))
+            shade_hits(static_cast<const medium&>(*bucket.mat), hits, bucket.count, world, emitters, q);
+        else if (type == typeid(dielectric))
+            shade_hits(static_cast<const dielectric&>(*bucket.mat), hits, bucket.count, world, emitters, q);
+        else if (type == typeid(diffuse_light))
+            shade_hits(static_cast<const diffuse_light&>(*bucket.mat), hits, bucket.count, world, emitters, q);
+        else if (type == typeid(isotropic))
+            shade_hits(static_cast<const isotropic&>(*bucket.mat), hits, bucket.count, world, emitters, q);
+        else if (type == typeid(mtl_material))
+            shade_hits(static_cast<const mtl_material&>(*bucket.mat), hits, bucket.count, world, emitters, q);
+        else
+            shade_hits(*bucket.mat, hits, bucket.count, world, emitters, q);
+    }
+
+    /*
+    shade() for count hits on mat, adding what they return to the batch's radiance and queueing the rays
+    they scatter in q.next. One scatter_record serves every hit, so the material's lobe pdf is reused.
+    */
+    template <typename M>
+    void shade_hits(const M& mat, const size_t* hits, size_t count, const hittable& world, const hittable& emitters, wavefront_queues& q) {
+        scatter_record& srec = q.srec;
+        for (size_t n = 0; n < count; n++) {
+            const wavefront_path& path = q.paths[hits[n]];
+            const hit_record& rec = q.records[hits[n]];
+            const ray& r = path.r;
+            color emission = mat.emitted(r, rec, rec.u, rec.v, rec.p);
+
+            if (!mat.scatter(r, rec, srec)) {
+                q.radiance[path.pixel] += path.throughput * emission;
+                continue;
+            }
+            if (srec.skip_pdf) {
+                if (path.depth > 1)
+                    q.next.push_back({ srec.skip_pdf_ray, path.throughput * srec.attenuation, path.pixel, path.depth - 1 });
+                continue;
+            }
+
+            sample_transmitters(r, rec, world, [&](const transmitter&, const ray&, double irradiance) {
+                emission += srec.attenuation * irradiance;
+            });
+            q.radiance[path.pixel] += path.throughput * emission;
+            if (path.depth <= 1)
+                continue;
+
+            double pdf_value;
+            ray scattered = sample_scattered(r, rec, srec.pdf_ptr, emitters, pdf_value);
+            double scattering_pdf = mat.scattering_pdf(r, rec, scattered);
+            q.next.push_back({ scattered, path.throughput * srec.attenuation * scattering_pdf / pdf_value, path.pixel, path.depth - 1 });
+        }
+    }
+
+    /*Merges the workers' range-Doppler grids and writes one image per band*/
+    void write_range_doppler(const frame_buffer& frame) const {
+        std::string stem = output_path.empty() ? "range_doppler" : output_path.substr(0, output_path.rfind(".ppm"));
+        size_t workers = frame.returns.size() / frame_channels();
+        for (int c = 0; c < frame_channels(); c++) {
+            range_doppler_grid merged = frame.returns[c];
+            for (size_t w = 1; w < workers; w++)
+                merged.merge(frame.returns[w * frame_channels() + c]);
+            merged.detect();
+            if (ground_range)
+                merged = merged.ground_projected(height_above_ground(center));
+            merged.write(stem + channel_suffix(c), postprocess, threads);
+        }
+
+        if (!frame.costs.empty())
+            frame.costs.write(cost_map_path);
+    }
+
+    /*
+    render_pixel from radar returns, channel by channel, over pulse p or every pulse when pixels integrate
+    them. Coherent pixels sum each return's amplitude sqrt(energy), scaled by its polarization channel's
+    Jones factor, with the phase of its path length into plane(p, c) of the field; otherwise the returns'
+    energies add up as gray.
+    */
+    void render_pixel_channels(int i, int j, int p, const hittable& world, const hittable& emitters, frame_buffer& frame) {
+        render_stats before = thread_stats;
+        auto start = std::chrono::steady_clock::now();
+
+        double wavelength[BAND_COUNT];
+        size_t index[BAND_COUNT * POL_COUNT];
+        for (int c = 0; c < frame_channels(); c++) {
+            wavelength[c / frame_pols()] = SPECTRAL_MAP.find(frame_band(c / frame_pols()))->second;
+            index[c] = plane(p, c) + size_t(j) * image_width + i;
+            if (!coherent)
+                frame.pixels[index[c]] = color(0, 0, 0);
+        }
+
+        double scale = pixel_samples_scale / pixel_pulses();
+        for (int k = p; k < p + pixel_pulses(); k++) {
+            point3 antenna = pulse_position(k);
+            pixel_returns(i, j, k, world, emitters, [&](double weight, const color (&energy)[BAND_COUNT], const double (&jones)[POL_COUNT], const point3& first, const point3& last, double between, const transmitter* source) {
+                double path = ((first - antenna).length() + between + (last - (source ? source->position : antenna)).length()) / 2.0;
+                for (int c = 0; c < frame_channels(); c++) {
+                    int b = c / frame_pols();
+                    double e = scale * weight * average(energy[b]);
+                    double gain = jones[c % frame_pols()];
+                    if (coherent)
+                        frame.field.add(index[c], std::sqrt(e) * gain, two_way_phase(path, wavelength[b]));
+                    else
+                        frame.pixels[index[c]] += color(1, 1, 1) * (e * gain * gain);
+                }
+            });
+        }
+
+        if (!frame.costs.empty() && p == 0) {
+            std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            frame.costs.record(i, j, thread_stats.bvh_nodes - before.bvh_nodes, thread_stats.prim_tests - before.prim_tests, elapsed.count());
+        }
+    }
+
+    /*Traces the samples of pixel i, j from pulse p and bins every return into this worker's range-Doppler grids*/
+    void render_pixel_returns(int i, int j, int p, const hittable& world, const hittable& emitters, frame_buffer& frame, int worker_index) {
+        render_stats before = thread_stats;
+        auto start = std::chrono::steady_clock::now();
+
+        range_doppler_grid* grids = &frame.returns[size_t(worker_index) * frame_channels()];
+        point3 antenna = pulse_position(p);
+        pixel_returns(i, j, p, world, emitters, [&](double weight, const color (&energy)[BAND_COUNT], const double (&jones)[POL_COUNT], const point3& first, const point3& last, double between, const transmitter* source) {
+            // Bistatic ranges are half the range sum, from the transmitter in and out to the receiver
+            double range = (track.range(first) + between + (source ? (source->position - last).length() : track.range(last))) / 2.0;
+            double azimuth = (track.azimuth(first) + track.azimuth(last)) / 2.0;
+            for (int c = 0; c < frame_channels(); c++) {
+                int b = c / frame_pols();
+                double e = pixel_samples_scale / pulses * weight * average(energy[b]);
+                double gain = jones[c % frame_pols()];
+                if (coherent) {
+                    double path = ((first - antenna).length() + between + (last - (source ? source->position : antenna)).length()) / 2.0;
+                    grids[c].add(range, azimuth, std::sqrt(e) * gain, two_way_phase(path, SPECTRAL_MAP.find(frame_band(b))->second));
+                }
+                else {
+                    grids[c].add(range, azimuth, e * gain * gain);
+                }
+            }
+        });
+
+        if (!frame.costs.empty() && p == 0) {
+            std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            frame.costs.record(i, j, thread_stats.bvh_nodes - before.bvh_nodes, thread_stats.prim_tests - before.prim_tests, elapsed.count());
+        }
+    }
+
+    /*Height of p above the ground plane, which lies ground_height along vup from the origin*/
+    double height_above_ground(const point3& p) const { return dot(p, unit_vector(vup)) - ground_height; }
+
+    /*Ground point under range-Doppler bin (k, a) of a ground range image: k along the look direction, a along track*/
+    point3 ground_point(const range_doppler_grid& image, int k, int a) const {
+        vec3 up = unit_vector(vup);
+        vec3 look = -w - dot(-w, up) * up;
+        vec3 along = track.direction - dot(track.direction, up) * up;
+        vec3 across = unit_vector(look - dot(look, along) / along.length_squared() * along);
+        point3 p = track.origin + image.azimuth_at(a) * track.direction + image.range_at(k) * across;
+        return p - height_above_ground(p) * up;
+    }
+
+    /*Merges the workers' phase histories, writes them and their backprojected ground range image, one per band*/
+    void write_phase_history(const frame_buffer& frame) const {
+        std::string stem = output_path.empty() ? "phase_history" : output_path.substr(0, output_path.rfind(".ppm"));
+        std::vector<point3> positions;
+        for (int p = 0; p < pulses; p++)
+            positions.push_back(pulse_position(p));
+
+        size_t workers = frame.echoes.size() / frame_channels();
+        for (int c = 0; c < frame_channels(); c++) {
+            phase_history merged = frame.echoes[c];
+            for (size_t w = 1; w < workers; w++)
+                merged.merge(frame.echoes[w * frame_channels() + c]);
+            std::string prefix = stem + channel_suffix(c);
+            merged.write(prefix + "_phase", positions);
+
+            trace_scope focus_span("backprojection", "render", band_name(frame_band(c / frame_pols())));
+            double height = height_above_ground(center);
+            auto ground = [height](double r) { return r > height ? std::sqrt(r * r - height * height) : 0.0; };
+            range_doppler_grid image(range_bins, azimuth_bins, interval(ground(range_extent.min), ground(range_extent.max)), azimuth_extent);
+            merged.backproject(image, positions, [&](int k, int a) { return ground_point(image, k, a); }, threads);
+            image.write(prefix, postprocess, threads);
+        }
+
+        if (!frame.costs.empty())
+            frame.costs.write(cost_map_path);
+    }
+
+    /*Traces pixel i, j from pulse's antenna position, adding every return to this worker's phase histories*/
+    void render_pixel_echoes(int i, int j, int pulse, const hittable& world, const hittable& emitters, frame_buffer& frame, int worker_index) {
+        render_stats before = thread_stats;
+        auto start = std::chrono::steady_clock::now();
+
+        point3 antenna = pulse_position(pulse);
+        phase_history* echoes = &frame.echoes[size_t(worker_index) * frame_channels()];
+        pixel_returns(i, j, pulse, world, emitters, [&](double weight, const color (&energy)[BAND_COUNT], const double (&jones)[POL_COUNT], const point3& first, const point3& last, double between, const transmitter* source) {
+            double range = ((first - antenna).length() + between + (last - (source ? source->position : antenna)).length()) / 2.0;
+            for (int c = 0; c < frame_channels(); c++)
+                echoes[c].add(pulse, range, std::sqrt(pixel_samples_scale * weight * average(energy[c / frame_pols()])) * jones[c % frame_pols()]);
+        });
+
+        if (!frame.costs.empty() && pulse == 0) {
+            std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            frame.costs.record(i, j, thread_stats.bvh_nodes - before.bvh_nodes, thread_stats.prim_tests - before.prim_tests, elapsed.count());
+        }
+    }
+
+    static double average(const color& c) { return (c.x() + c.y() + c.z()) / 3.0; }
+
+    /*The antenna pattern weights both ways for the colocated radar, and on receive only when transmitters illuminate*/
+    double beam_power() const { return transmitters.empty() ? 2.0 : 1.0; }
+
+    /*
+    pulse_ray weighted by the antenna pattern's gain toward it. Range-Doppler and phase history images
+    keep no pixels, so with a pattern their samples are drawn from the beam rather than pixel i, j, and the
+    weight is divided by the sample's density. Side-looking projections weight pixel i, j's samples instead.
+    */
+    ray beam_ray(int i, int j, int s_i, int s_j, int p, double& weight) const {
+        if (antenna.empty()) {
+            weight = 1.0;
+            return pulse_ray(i, j, s_i, s_j, p);
+        }
+
+        double x, y, density = 1.0;
+        ray r;
+        if ((range_doppler || record_phase_history) && projection == PERSPECTIVE) {
+            density = beam.sample(x, y);
+            r = get_ray_at(image_width / 2.0 + x * focus_dist / pixel_delta_u.length() - 0.5,
+                image_height / 2.0 - y * focus_dist / pixel_delta_v.length() - 0.5);
+        }
+        else {
+            r = get_ray(i, j, s_i, s_j);
+            image_plane_point(r.direction(), x, y);
+        }
+        weight = std::pow(antenna.gain(x, y), beam_power()) / density;
+        return pulse_ray(r, p);
+    }
+
+    /*Image plane coordinates of direction d: the tangents of its angles right of and above the view direction*/
+    void image_plane_point(const vec3& d, double& x, double& y) const {
+        double forward = -dot(d, w);
+        x = dot(d, u) / forward;
+        y = dot(d, v) / forward;
+    }
+
+    /*Ray g_i, g_j of pixel i, j's regular SBR grid from pulse p, weighted like beam_ray relative to a Monte Carlo sample*/
+    ray sbr_ray(int i, int j, int g_i, int g_j, int p, double& weight) const {
+        ray r = get_ray_at(i + (g_i + 0.5) / sbr_rays - 0.5, j + (g_j + 0.5) / sbr_rays - 0.5);
+        weight = 1.0 / (sbr_rays * sbr_rays * pixel_samples_scale);
+        if (!antenna.empty()) {
+            double x, y;
+            image_plane_point(r.direction(), x, y);
+            weight *= std::pow(antenna.gain(x, y), beam_power());
+        }
+        return pulse_ray(r, p);
+    }
+
+    /*
+    Traces the samples of pixel i, j from pulse p, calling on_return(weight, energy, jones, first, last,
+    between, source) for every return (see trace_returns), where weight is the sample's weight relative to
+    a plain Monte Carlo sample. With sbr_rays set, mirror chains come from the pixel's SBR grid instead.
+    With facet_backscatter set, each sample returns trace_facet's single bounce and nothing else.
+    */
+    template <typename F>
+    void pixel_returns(int i, int j, int p, const hittable& world, const hittable& emitters, F&& on_return) {
+        double weight;
+        auto weighted = [&](const color (&energy)[BAND_COUNT], const double (&jones)[POL_COUNT], const point3& first, const point3& last, double between, const transmitter* source) {
+            on_return(weight, energy, jones, first, last, between, source);
+        };
+        for (int s_j = 0; s_j < sqrt_spp; s_j++) {
+            for (int s_i = 0; s_i < sqrt_spp; s_i++) {
+                ray r = beam_ray(i, j, s_i, s_j, p, weight);
+                if (facet_backscatter)
+                    trace_facet(r, world, weighted);
+                else
+                    trace_returns(r, world, emitters, weighted);
+            }
+        }
+        int grid = facet_backscatter ? 0 : sbr_rays;
+        for (int g_j = 0; g_j < grid; g_j++) {
+            for (int g_i = 0; g_i < grid; g_i++) {
+                ray r = sbr_ray(i, j, g_i, g_j, p, weight);
+                trace_mirror_returns(r, world, weighted);
+            }
+        }
+    }
+
+    /*
+    Shooting and bouncing rays: follows the exact mirror reflection of r through up to sbr_bounces smooth
+    surfaces, calling on_return like trace_returns whenever a reflection reaches an emitter, and joining
+    every surface after the first reflection to the transmitters by a shadow ray scattered off its diffuse
+    part (facet_params::diffuse). Each bounce weighs the path by the surface's expected mirror reflectance
+    (material::mirror_weights) instead of picking a lobe at random, so the specular returns a Monte Carlo
+    path finds only by chance come out noise free from a single ray; trace_returns leaves these chains out
+    when sbr_rays is set. The chain stops at the first surface with no mirror component. Fuzzy reflections
+    are traced as perfect mirrors.
+    */
+    template <typename F>
+    void trace_mirror_returns(ray r, const hittable& world, F&& on_return) {
+        color throughput[BAND_COUNT];
+        color energy[BAND_COUNT];
+        color mirror[BAND_COUNT];
+        for (int b = 0; b < BAND_COUNT; b++)
+            throughput[b] = color(1, 1, 1);
+
+        point3 first, last;
+        double between = 0.0;
+        vec3 field_h = horizontal_field(r.direction(), vup, u);
+        vec3 field_v = vertical_field(r.direction(), vup, u);
+        double jones[POL_COUNT] = { 1, 1, 1, 1 };
+
+        for (int bounce = 0; bounce <= sbr_bounces; bounce++) {
+            hit_record rec;
+
+            thread_stats.rays++;
+            if (!world.hit(r, interval(0.001, infinity), rec))
+                return;
+
+            if (bounce > 0) {
+                band_scatter bs;
+                rec.mat->scatter_bands(r, rec, bs);
+                bool lit = false;
+                for (int b = 0; b < BAND_COUNT; b++) {
+                    energy[b] = throughput[b] * bs.emission[b];
+                    lit = lit || energy[b].length_squared() > 0;
+                }
+                if (lit) {
+                    if (polarimetric)
+                        project_fields(field_h, field_v, r.direction(), jones);
+                    on_return(energy, jones, first, last, between, (const transmitter*)nullptr);
+                }
+
+                facet_params f;
+                rec.mat->facet(rec, f);
+                double to_hit = between + (rec.p - last).length();
+                sample_transmitters(r, rec, world, [&](const transmitter& source, const ray& shadow, double irradiance) {
+                    for (int b = 0; b < BAND_COUNT; b++)
+                        energy[b] = throughput[b] * f.diffuse[b] * irradiance;
+                    if (polarimetric)
+                        project_fields(depolarized_field(shadow.direction()), depolarized_field(shadow.direction()), shadow.direction(), jones);
+                    on_return(energy, jones, first, rec.p, to_hit, &source);
+                });
+            }
+            if (bounce == sbr_bounces)
+                return;
+
+            rec.mat->mirror_weights(rec, mirror);
+            bool reflects = false;
+            for (int b = 0; b < BAND_COUNT; b++) {
+                throughput[b] = throughput[b] * mirror[b];
+                reflects = reflects || throughput[b].length_squared() > 0;
+            }
+            if (!reflects)
+                return;
+
+            if (bounce > 0)
+                between += (rec.p - last).length();
+            else
+                first = rec.p;
+            last = rec.p;
+
+            vec3 reflected = reflect(unit_vector(r.direction()), rec.normal);
+            if (polarimetric) {
+                field_h = specular_field(field_h, r.direction(), rec.normal, reflected);
+                field_v = specular_field(field_v, r.direction(), rec.normal, reflected);
+            }
+            r = ray(rec.p, reflected, r.time());
+        }
+    }
+
+    /*
+    Facet backscatter preview: one ray per sample and no bounces. At r's first hit the analytic facet
+    model (facet_params::scattering) gives the return from the facet normal, the incidence angle and the
+    material's facet parameters (material::facet), calling on_return like trace_returns with the hit as
+    both first and last scatterer. Its scattering coefficients are divided by 4 cos_o for the footprint a
+    sample covers, so a diffuse return is albedo * cos_i like the colocated radar's single bounce. Light
+    comes from the antenna along r, which needs no occlusion check, or with transmitters from each one
+    not blocked by a shadow ray, scaled by its gain.
+    */
+    template <typename F>
+    void trace_facet(const ray& r, const hittable& world, F&& on_return) {
+        hit_record rec;
+        thread_stats.rays++;
+        if (!world.hit(r, interval(0.001, infinity), rec))
+            return;
+
+        facet_params f;
+        rec.mat->facet(rec, f);
+        vec3 out = -unit_vector(r.direction());
+        double cos_o = dot(rec.normal, out);
+        if (cos_o <= 0)
+            return;
+
+        auto facet_return = [&](const vec3& in, double gain, const transmitter* source) {
+            if (dot(rec.normal, in) <= 0)
+                return;
+            color diffuse[BAND_COUNT], specular[BAND_COUNT];
+            f.scattering(rec.normal, in, out, diffuse, specular);
+            bool any_specular = false;
+            for (int b = 0; b < BAND_COUNT; b++) {
+                diffuse[b] = gain / (4 * cos_o) * diffuse[b];
+                specular[b] = gain / (4 * cos_o) * specular[b];
+                any_specular = any_specular || specular[b].length_squared() > 0;
+            }
+
+            // The diffuse part comes back depolarized, the specular part as from a mirror
+            double jones[POL_COUNT] = { 1, 1, 1, 1 };
+            vec3 field_h = horizontal_field(-in, vup, u);
+            vec3 field_v = vertical_field(-in, vup, u);
+            if (polarimetric)
+                project_fields(depolarized_field(out), depolarized_field(out), out, jones);
+            on_return(diffuse, jones, rec.p, rec.p, 0.0, source);
+            if (any_specular) {
+                if (polarimetric)
+                    project_fields(specular_field(field_h, -in, rec.normal, out), specular_field(field_v, -in, rec.normal, out), out, jones);
+                on_return(specular, jones, rec.p, rec.p, 0.0, source);
+            }
+        };
+
+        if (transmitters.empty()) {
+            facet_return(out, 1.0, nullptr);
+            return;
+        }
+        for (const transmitter& source : transmitters) {
+            vec3 to_source = source.position - rec.p;
+            double distance = to_source.length();
+            ray shadow(rec.p, to_source / distance, r.time());
+            thread_stats.rays++;
+            hit_record blocker;
+            if (!world.hit(shadow, interval(0.001, distance - 0.001), blocker))
+                facet_return(shadow.direction(), source.gain(-shadow.direction()), &source);
+        }
+    }
+
+    /*Whether rec's surface has a mirror component for trace_mirror_returns to follow*/
+    bool mirrors(const hit_record& rec) const {
+        color mirror[BAND_COUNT];
+        rec.mat->mirror_weights(rec, mirror);
+        for (int b = 0; b < BAND_COUNT; b++)
+            if (mirror[b].length_squared() > 0)
+                return true;
+        return false;
+    }
+
+    /*
+    Samples the ray leaving a diffuse hit from the material's lobe mixed with the emitters, or from the
+    lobe alone when there are none to sample (scenes lit only by transmitters). The mixture is mixture_pdf's
+    even split, with the emitters' pdf on the stack so no hit allocates one.
+    */
+    ray sample_scattered(const ray& r, const hit_record& rec, const shared_ptr<pdf>& lobe, const hittable& emitters, double& pdf_value) const {
+        if (emitters.bounding_box().x.size() < 0) {
+            ray scattered(rec.p, lobe->generate(), r.time());
+            pdf_value = lobe->value(scattered.direction());
+            return scattered;
+        }
+        hittable_pdf light(emitters, rec.p);
+        ray scattered(rec.p, random_double() < 0.5 ? light.generate() : lobe->generate(), r.time());
+        pdf_value = 0.5 * light.value(scattered.direction()) + 0.5 * lobe->value(scattered.direction());
+        return scattered;
+    }
+
+    /*
+    Next event estimation toward every transmitter from a diffuse hit: calls on_light(source, shadow,
+    irradiance) for each one the shadow ray reaches unblocked. irradiance is the transmitter's intensity
+    over the squared distance, times the material's scattering_pdf toward it, so multiplying it by the
+    hit's attenuation gives the light scattered back along r.
+    */
+    template <typename F>
+    void sample_transmitters(const ray& r, const hit_record& rec, const hittable& world, F&& on_light) const {
+        for (const transmitter& source : transmitters) {
+            vec3 to_source = source.position - rec.p;
+            double distance = to_source.length();
+            ray shadow(rec.p, to_source / distance, r.time());
+            double scattering_pdf = rec.mat->scattering_pdf(r, rec, shadow);
+            double intensity = source.intensity(-shadow.direction());
+            if (scattering_pdf <= 0 || intensity <= 0)
+                continue;
+
+            thread_stats.rays++;
+            hit_record blocker;
+            if (world.hit(shadow, interval(0.001, distance - 0.001), blocker))
+                continue;
+            on_light(source, shadow, scattering_pdf * intensity / (distance * distance));
+        }
+    }
+
+    /*Jones factors of fields arriving along d, received in the H and V basis of an antenna looking along -d*/
+    void project_fields(const vec3& field_h, const vec3& field_v, const vec3& d, double (&jones)[POL_COUNT]) const {
+        vec3 h = horizontal_field(-d, vup, u);
+        vec3 v = vertical_field(-d, vup, u);
+        jones[0] = dot(field_h, h);
+        jones[1] = dot(field_h, v);
+        jones[2] = dot(field_v, h);
+        jones[3] = dot(field_v, v);
+    }
+
+    /*
+    Follows one path like ray_color_bands, calling on_return(energy, jones, first, last, between, source)
+    each time it reaches an emitter (the colocated radar) after at least one scatterer, and at every
+    diffuse scatterer with a clear shadow ray to a transmitter. With sbr_rays set, returns whose scatterers
+    before the last were all mirror reflections are left to trace_mirror_returns. energy holds every band,
+    first and last are the first and last scatterers and between the path length from one to the other. jones holds the HH,
+    HV, VH and VV amplitude factors of the returned field when polarimetric, and ones otherwise. source is
+    the transmitter lighting the path, or null for the colocated radar.
+    */
+    template <typename F>
+    void trace_returns(ray r, const hittable& world, const hittable& emitters, F&& on_return) {
+        color throughput[BAND_COUNT];
+        color energy[BAND_COUNT];
+        for (int b = 0; b < BAND_COUNT; b++)
+            throughput[b] = color(1, 1, 1);
+
+        point3 first, last;
+        double between = 0.0;           // Path length from the first scatterer to the last
+        bool scattered_once = false;
+        int mirror_chain = sbr_rays > 0 ? 0 : -1;   // Mirror reflections so far, which SBR traces; -1 once broken
+
+        // Fields of the waves transmitted H and V
+        vec3 field_h = horizontal_field(r.direction(), vup, u);
+        vec3 field_v = vertical_field(r.direction(), vup, u);
+        double jones[POL_COUNT] = { 1, 1, 1, 1 };
+
+        for (int depth = max_depth; depth > 0; depth--) {
+            hit_record rec;
+
+            thread_stats.rays++;
+            if (!world.hit(r, interval(0.001, infinity), rec))
+                return;
+
+            band_scatter bs;
+            rec.mat->scatter_bands(r, rec, bs);
+            if (scattered_once) {
+                bool lit = false;
+                for (int b = 0; b < BAND_COUNT; b++) {
+                    energy[b] = throughput[b] * bs.emission[b];
+                    lit = lit || energy[b].length_squared() > 0;
+                }
+                if (lit && mirror_chain < 0) {
+                    if (polarimetric)
+                        project_fields(field_h, field_v, r.direction(), jones);
+                    on_return(energy, jones, first, last, between, (const transmitter*)nullptr);
+                }
+            }
+
+            if (!bs.scattered)
+                return;
+
+            bool mirrored = mirror_chain > 0;   // Transmitter returns from here belong to trace_mirror_returns
+            if (mirror_chain >= 0)
+                mirror_chain = bs.srec.skip_pdf && mirrors(rec) && mirror_chain < sbr_bounces ? mirror_chain + 1 : -1;
+
+            if (scattered_once)
+                between += (rec.p - last).length();
+            else
+                first = rec.p;
+            last = rec.p;
+            scattered_once = true;
+
+            if (bs.srec.skip_pdf) {
+                for (int b = 0; b < BAND_COUNT; b++)
+                    throughput[b] = throughput[b] * bs.weight[b];
+                if (polarimetric) {
+                    rec.mat->polarize(r, rec, bs.srec, bs.srec.skip_pdf_ray.direction(), field_h);
+                    rec.mat->polarize(r, rec, bs.srec, bs.srec.skip_pdf_ray.direction(), field_v);
+                }
+                r = bs.srec.skip_pdf_ray;
+                continue;
+            }
+
+            if (!mirrored) {
+                sample_transmitters(r, rec, world, [&](const transmitter& source, const ray& shadow, double irradiance) {
+                    for (int b = 0; b < BAND_COUNT; b++)
+                        energy[b] = throughput[b] * bs.weight[b] * irradiance;
+                    if (polarimetric) {
+                        vec3 shadow_h = field_h, shadow_v = field_v;
+                        rec.mat->polarize(r, rec, bs.srec, shadow.direction(), shadow_h);
+                        rec.mat->polarize(r, rec, bs.srec, shadow.direction(), shadow_v);
+                        project_fields(shadow_h, shadow_v, shadow.direction(), jones);
+                    }
+                    on_return(energy, jones, first, last, between, &source);
+                });
+            }
+
+            double pdf_value;
+            ray scattered = sample_scattered(r, rec, bs.srec.pdf_ptr, emitters, pdf_value);
+            double scattering_pdf = rec.mat->scattering_pdf(r, rec, scattered);
+
+            for (int b = 0; b < BAND_COUNT; b++)
+                throughput[b] = throughput[b] * bs.weight[b] * scattering_pdf / pdf_value;
+            if (polarimetric) {
+                rec.mat->polarize(r, rec, bs.srec, scattered.direction(), field_h);
+                rec.mat->polarize(r, rec, bs.srec, scattered.direction(), field_v);
+            }
+            r = scattered;
+        }
+    }
+
+    /*render_pixel for every band at once; band b of the pixel is stored in plane(p, b) of the frame*/
+    void render_pixel_bands(int i, int j, int p, const hittable& world, const hittable& emitters, frame_buffer& frame) {
+        render_stats before = thread_stats;
+        auto start = std::chrono::steady_clock::now();
+
+        color pixel_color[BAND_COUNT];
+        color sample_color[BAND_COUNT];
+        for (int k = p; k < p + pixel_pulses(); k++) {
+            for (int s_j = 0; s_j < sqrt_spp; s_j++) {
+                for (int s_i = 0; s_i < sqrt_spp; s_i++) {
+                    double weight;
+                    ray r = beam_ray(i, j, s_i, s_j, k, weight);
+                    ray_color_bands(r, world, emitters, sample_color);
+                    for (int b = 0; b < BAND_COUNT; b++)
+                        pixel_color[b] += weight * sample_color[b];
+                }
+            }
+        }
+
+        for (int b = 0; b < BAND_COUNT; b++)
+            frame.pixels[plane(p, b) + size_t(j) * image_width + i] = (pixel_samples_scale / pixel_pulses()) * pixel_color[b];
+
+        if (!frame.costs.empty() && p == 0) {
+            std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            frame.costs.record(i, j, thread_stats.bvh_nodes - before.bvh_nodes, thread_stats.prim_tests - before.prim_tests, elapsed.count());
+        }
+    }
+
+    /*
+    ray_color for every band along one shared path: each band keeps its own throughput, and materials
+    pick one lobe for all bands through material::scatter_bands.
+    */
+    void ray_color_bands(ray r, const hittable& world, const hittable& emitters, color (&radiance)[BAND_COUNT]) {
+        color throughput[BAND_COUNT];
+        for (int b = 0; b < BAND_COUNT; b++) {
+            throughput[b] = color(1, 1, 1);
+            radiance[b] = color(0, 0, 0);
+        }
+
+        for (int depth = max_depth; depth > 0; depth--) {
+            hit_record rec;
+
+            thread_stats.rays++;
+            if (!world.hit(r, interval(0.001, infinity), rec)) {
+                for (int b = 0; b < BAND_COUNT; b++)
+                    radiance[b] += throughput[b] * background;
+                return;
+            }
+
+            band_scatter bs;
+            rec.mat->scatter_bands(r, rec, bs);
+            for (int b = 0; b < BAND_COUNT; b++)
+                radiance[b] += throughput[b] * bs.emission[b];
+
+            if (!bs.scattered)
+                return;
+
+            if (bs.srec.skip_pdf) {
+                for (int b = 0; b < BAND_COUNT; b++)
+                    throughput[b] = throughput[b] * bs.weight[b];
+                r = bs.srec.skip_pdf_ray;
+                continue;
+            }
+
+            sample_transmitters(r, rec, world, [&](const transmitter&, const ray&, double irradiance) {
+                for (int b = 0; b < BAND_COUNT; b++)
+                    radiance[b] += throughput[b] * bs.weight[b] * irradiance;
+            });
+
+            double pdf_value;
+            ray scattered = sample_scattered(r, rec, bs.srec.pdf_ptr, emitters, pdf_value);
+            double scattering_pdf = rec.mat->scattering_pdf(r, rec, scattered);
+
+            for (int b = 0; b < BAND_COUNT; b++)
+                throughput[b] = throughput[b] * bs.weight[b] * scattering_pdf / pdf_value;
+            r = scattered;
+        }
     }
 
     /*Returns the vector to a random point in the square subpixel specified by grid indices s_i, s_j, for unit square pixel [-.5, -.5] to [+.5, +.5]*/
@@ -165,9 +1626,14 @@ private:
         
         hit_record rec;
 
+        thread_stats.rays++;
         if (!world.hit(r, interval(0.001, infinity), rec))
             return background;
-            
+        return shade(r, rec, depth, world, emitters);
+    }
+
+    /*ray_color of a ray known to hit rec first*/
+    color shade(const ray& r, const hit_record& rec, int depth, const hittable& world, const hittable& emitters) {
         scatter_record srec;
         color color_from_emission(rec.mat->emitted(r, rec, rec.u, rec.v, rec.p));
 
@@ -178,11 +1644,12 @@ private:
             return srec.attenuation * ray_color(srec.skip_pdf_ray, depth - 1, world, emitters);
         }
         
-        auto light_ptr = make_shared<hittable_pdf>(emitters, rec.p);
-        mixture_pdf p(light_ptr, srec.pdf_ptr);
+        sample_transmitters(r, rec, world, [&](const transmitter&, const ray&, double irradiance) {
+            color_from_emission += srec.attenuation * irradiance;
+        });
 
-        ray scattered = ray(rec.p, p.generate(), r.time());
-        double pdf_value = p.value(scattered.direction());
+        double pdf_value;
+        ray scattered = sample_scattered(r, rec, srec.pdf_ptr, emitters, pdf_value);
 
         double scattering_pdf = rec.mat->scattering_pdf(r, rec, scattered);
 
@@ -0,0 +1,45 @@
+#ifndef COHERENT_H
+#define COHERENT_H
+
+/*
+* Complex amplitude accumulation for coherent imaging. A radar return carries the phase of its path
+* length, and summing returns as complex amplitudes before taking the power gives the speckle of real SAR
+* images. Buffers keep their real and imaginary parts in separate float arrays, so loops over them
+* vectorize and a coherent image costs about as much memory as the color image it replaces.
+*/
+
+#include <cmath>
+#include <vector>
+
+/*Phase of a return with one-way range r: -4*pi*r/wavelength, reduced first so long ranges keep their precision*/
+inline double two_way_phase(double r, double wavelength) {
+	return -4.0 * pi * std::fmod(r / wavelength, 1.0);
+}
+
+struct complex_buffer {
+	std::vector<float> re;
+	std::vector<float> im;
+
+	complex_buffer() {}
+	explicit complex_buffer(size_t size) : re(size, 0.0f), im(size, 0.0f) {}
+
+	bool empty() const { return re.empty(); }
+	size_t size() const { return re.size(); }
+
+	void add(size_t i, double amplitude, double phase) {
+		re[i] += float(amplitude * std::cos(phase));
+		im[i] += float(amplitude * std::sin(phase));
+	}
+
+	void merge(const complex_buffer& other) {
+		for (size_t i = 0; i < re.size(); i++) {
+			re[i] += other.re[i];
+			im[i] += other.im[i];
+		}
+	}
+
+	/*Square-law detection: the power of the summed amplitude*/
+	double power(size_t i) const { return double(re[i]) * re[i] + double(im[i]) * im[i]; }
+};
+
+#endif // COHERENT_H
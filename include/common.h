@@ -6,10 +6,13 @@
 */
 
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <random>
+#include <string>
 
 using std::make_shared;
 using std::shared_ptr;
@@ -25,9 +28,20 @@ inline double degrees_to_radians(double degrees) {
 	return degrees * pi / 180.0;
 }
 
+/*Per-thread generator so worker threads never share (or lock) random state*/
+inline std::mt19937_64& random_engine() {
+	thread_local std::mt19937_64 engine(5489u);
+	return engine;
+}
+
+/*Reseeds the calling thread's generator*/
+inline void seed_random(uint64_t seed) {
+	random_engine().seed(seed);
+}
+
 /*Returns a random real in range [0, 1)*/
 inline double random_double() {
-	return std::rand() / (RAND_MAX + 1.0);
+	return (random_engine()() >> 11) * 0x1.0p-53;
 }
 
 /*Returns a random real in range [min, max)*/
@@ -35,6 +49,13 @@ inline double random_double(double min, double max) {
 	return min + (max - min) * random_double();
 }
 
+/*Parses all of s as a real number; false if s is empty or has anything after the number*/
+inline bool parse_double(const std::string& s, double& value) {
+	char* end = nullptr;
+	value = std::strtod(s.c_str(), &end);
+	return !s.empty() && end == s.c_str() + s.size();
+}
+
 /*Returns a random integer in [min,max].*/
 inline int random_int(int min, int max) {
 	return int(random_double(min, max + 1));
@@ -0,0 +1,68 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+/*
+* Calls back on a background thread when a file's modification time changes. Polling keeps it portable
+* and is cheap at the one-second intervals long renders need.
+*/
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class file_watcher {
+public:
+	file_watcher(const std::string& path, double interval, std::function<void()> on_change)
+		: path(path), interval(interval), on_change(std::move(on_change)) {
+		last_write = modified();
+		poller = std::thread([this] { run(); });
+	}
+
+	~file_watcher() {
+		{
+			std::lock_guard<std::mutex> lock(wake_mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		poller.join();
+	}
+
+	file_watcher(const file_watcher&) = delete;
+	file_watcher& operator=(const file_watcher&) = delete;
+
+private:
+	std::string path;
+	double interval;
+	std::function<void()> on_change;
+	std::filesystem::file_time_type last_write;
+
+	std::thread poller;
+	std::mutex wake_mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+
+	std::filesystem::file_time_type modified() const {
+		std::error_code error;	// A file being replaced may briefly not exist
+		auto time = std::filesystem::last_write_time(path, error);
+		return error ? last_write : time;
+	}
+
+	void run() {
+		std::unique_lock<std::mutex> lock(wake_mutex);
+		while (!wake.wait_for(lock, std::chrono::duration<double>(interval), [this] { return stopping; })) {
+			auto time = modified();
+			if (time == last_write)
+				continue;
+			last_write = time;
+			lock.unlock();
+			on_change();
+			lock.lock();
+		}
+	}
+};
+
+#endif // FILE_WATCHER_H
@@ -0,0 +1,60 @@
+#ifndef FOOTPRINT_H
+#define FOOTPRINT_H
+
+/*
+* Illuminated footprints, for leaving geometry the radar never sees out of the acceleration structures.
+* Each camera bounds the rays it can trace by a convex volume of half-spaces (see
+* camera::illuminated_volume); a footprint is the union of the volumes of every view sharing a world.
+* A box survives when it comes within a margin of any volume, the margin leaving room for multipath
+* through geometry just outside the beam.
+*/
+
+#include "aabb.h"
+
+#include <vector>
+
+/*The points p with dot(normal, p) <= offset; normal is a unit vector*/
+struct half_space {
+	vec3 normal;
+	double offset;
+};
+
+class footprint {
+public:
+	void add(const std::vector<half_space>& volume, double margin) {
+		volumes.push_back({ volume, margin });
+	}
+
+	bool empty() const { return volumes.empty(); }
+
+	/*Whether box comes within the margin of some volume: no single half-space of it excludes the box*/
+	bool touches(const aabb& box) const {
+		for (const convex& c : volumes) {
+			bool inside = true;
+			for (const half_space& h : c.planes) {
+				// The box corner furthest into the half-space
+				double nearest = 0.0;
+				for (int axis = 0; axis < 3; axis++) {
+					const interval& span = box.axis_interval(axis);
+					nearest += h.normal[axis] * (h.normal[axis] > 0 ? span.min : span.max);
+				}
+				if (nearest > h.offset + c.margin) {
+					inside = false;
+					break;
+				}
+			}
+			if (inside)
+				return true;
+		}
+		return false;
+	}
+
+private:
+	struct convex {
+		std::vector<half_space> planes;
+		double margin;
+	};
+	std::vector<convex> volumes;
+};
+
+#endif // FOOTPRINT_H
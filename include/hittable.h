@@ -3,6 +3,11 @@
 
 #include "aabb.h"
 
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
 class material;
 
 class hit_record {
@@ -22,6 +27,97 @@ public:
 	}
 };
 
+/*
+A triangle of the world as the rasterizer sees it (see rasterizer.h): world space vertices, with the
+texture coordinates a hit interpolates between them by barycentric weight
+*/
+struct world_triangle {
+	point3 v[3];
+	vec3 uv[3];
+	shared_ptr<material> mat;
+	bool front_always = false;	// Hits count as front facing, as they do through scale and rotate_xyz
+};
+
+/*Takes an object's points to world space, see hittable::triangulate*/
+using placement = std::function<point3(const point3&)>;
+
+/*
+Up to max_size coherent rays traced together by hittable::hit_packet, each keeping its closest hit so
+far. Rays are picked by bit masks of their indices. bound() gathers the interval arithmetic bounds over
+all rays that let bvh_node reject a whole packet with one test.
+*/
+struct ray_packet {
+	static const int max_size = 64;
+	static const int min_active = 4;	// Below this many rays through a node, bvh_node traces them one by one
+
+	int size = 0;
+	ray rays[max_size];
+	double t_min = 0.001;
+	double t_max[max_size];		// The closest hit so far, or the far end of the ray
+	bool found[max_size];
+	hit_record rec[max_size];
+
+	interval origin[3];			// Spans of the ray origins per axis
+	interval inv_direction[3];	// Spans of 1 / direction per axis, where every ray has the same sign
+	bool bounded[3];
+
+	void add(const ray& r, double far = infinity) {
+		rays[size] = r;
+		t_max[size] = far;
+		found[size] = false;
+		size++;
+	}
+
+	uint64_t all() const { return size == max_size ? ~uint64_t(0) : (uint64_t(1) << size) - 1; }
+
+	/*Bounds the rays in `active` for misses*/
+	void bound(uint64_t active) {
+		for (int axis = 0; axis < 3; axis++) {
+			origin[axis] = interval::empty;
+			inv_direction[axis] = interval::empty;
+			bool positive = active && rays[std::countr_zero(active)].direction()[axis] > 0;
+			bounded[axis] = true;
+			for (uint64_t m = active; m; m &= m - 1) {
+				int k = std::countr_zero(m);
+				double o = rays[k].origin()[axis], d = rays[k].direction()[axis];
+				origin[axis] = interval(origin[axis], interval(o, o));
+				inv_direction[axis] = interval(inv_direction[axis], interval(1.0 / d, 1.0 / d));
+				bounded[axis] = bounded[axis] && d != 0.0 && (d > 0) == positive;
+			}
+		}
+	}
+
+	/*Whether no ray of the packet can meet box before the furthest t_max of the rays in `active`*/
+	bool misses(const aabb& box, uint64_t active) const {
+		double far = t_min;
+		for (uint64_t m = active; m; m &= m - 1)
+			far = std::fmax(far, t_max[std::countr_zero(m)]);
+
+		double enter = t_min, exit = far;
+		for (int axis = 0; axis < 3; axis++) {
+			if (!bounded[axis])
+				continue;
+			const interval& slab = box.axis_interval(axis);
+			bool positive = inv_direction[axis].min > 0;
+			interval near = span(positive ? slab.min : slab.max, axis), away = span(positive ? slab.max : slab.min, axis);
+			enter = std::fmax(enter, near.min);
+			exit = std::fmin(exit, away.max);
+			if (exit < enter)
+				return true;
+		}
+		return false;
+	}
+
+private:
+	/*The span of (plane - origin) / direction over every ray, by interval arithmetic*/
+	interval span(double plane, int axis) const {
+		double a = plane - origin[axis].max, b = plane - origin[axis].min;
+		double d0 = inv_direction[axis].min, d1 = inv_direction[axis].max;
+		double p[4] = { a * d0, a * d1, b * d0, b * d1 };
+		return interval(std::fmin(std::fmin(p[0], p[1]), std::fmin(p[2], p[3])), std::fmax(std::fmax(p[0], p[1]), std::fmax(p[2], p[3])));
+	}
+};
+
 class hittable {
 public: 
 	virtual ~hittable() = default;
@@ -29,10 +125,62 @@ public:
 	virtual aabb bounding_box() const { return bbox; }
 	virtual double pdf_value(const point3& origin, const vec3& direction) const { return 0.0; }
 	virtual vec3 random(const point3& origin) const { return vec3(1, 0, 0); }
+
+	/*
+	Appends the object's surfaces to `out` as triangles moved by `place`. Returns false when some of them
+	are not triangles, leaving whatever it appended for the caller to drop.
+	*/
+	virtual bool triangulate(const placement& place, std::vector<world_triangle>& out) const { return false; }
+
+	/*Finds the closest hits of the packet's `active` rays, ray by ray unless overridden*/
+	virtual void hit_packet(ray_packet& packet, uint64_t active) const {
+		hit_record rec;
+		for (uint64_t m = active; m; m &= m - 1) {
+			int k = std::countr_zero(m);
+			if (hit(packet.rays[k], interval(packet.t_min, packet.t_max[k]), rec)) {
+				packet.rec[k] = rec;
+				packet.t_max[k] = rec.t;
+				packet.found[k] = true;
+			}
+		}
+	}
 private:
 	aabb bbox;
 };
 
+/*
+hit_packet through a transform wrapper: the rays mapped by to_object go through `object` as one packet,
+and to_world(r, object_r, rec) moves each new hit back, as the wrapper's hit does. Too few rays to be
+worth a packet of their own go through the wrapper's hit one by one.
+*/
+template <typename ToObject, typename ToWorld>
+void hit_packet_through(const hittable& wrapper, const hittable& object, ray_packet& packet, uint64_t active, ToObject&& to_object, ToWorld&& to_world) {
+	if (std::popcount(active) < ray_packet::min_active) {
+		wrapper.hittable::hit_packet(packet, active);
+		return;
+	}
+	ray_packet moved;
+	moved.t_min = packet.t_min;
+	moved.size = packet.size;
+	for (uint64_t m = active; m; m &= m - 1) {
+		int k = std::countr_zero(m);
+		moved.rays[k] = to_object(packet.rays[k]);
+		moved.t_max[k] = packet.t_max[k];
+		moved.found[k] = false;
+	}
+	moved.bound(active);
+	object.hit_packet(moved, active);
+	for (uint64_t m = active; m; m &= m - 1) {
+		int k = std::countr_zero(m);
+		if (!moved.found[k])
+			continue;
+		to_world(packet.rays[k], moved.rays[k], moved.rec[k]);
+		packet.rec[k] = moved.rec[k];
+		packet.t_max[k] = moved.rec[k].t;
+		packet.found[k] = true;
+	}
+}
+
 class scale : public hittable {
 public:
 	scale(shared_ptr<hittable> object, const vec3& scale) : object(object), scale_factor(scale) {
@@ -40,21 +188,30 @@ public:
 	}
 
 	bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-		vec3 inv_scale = inverse(scale_factor);
-		ray unscaled_r(r.origin() * inv_scale, r.direction() * inv_scale, r.time());
+		ray unscaled_r = to_object(r);
 
 		if (!object->hit(unscaled_r, ray_t, rec))
 			return false;
 
-		vec3 normal = unit_vector(rec.normal * inv_scale);
-
-		rec.p *= scale_factor;
-		rec.set_face_normal(unscaled_r, normal);
-
+		to_world(unscaled_r, rec);
 		return true;
 	}
 	aabb bounding_box() const override { return bbox; }
 
+	void hit_packet(ray_packet& packet, uint64_t active) const override {
+		hit_packet_through(*this, *object, packet, active, [&](const ray& r) { return to_object(r); },
+			[&](const ray&, const ray& unscaled_r, hit_record& rec) { to_world(unscaled_r, rec); });
+	}
+
+	bool triangulate(const placement& place, std::vector<world_triangle>& out) const override {
+		vec3 factor = scale_factor;
+		size_t first = out.size();
+		bool all = object->triangulate([&](const point3& p) { return place(p * factor); }, out);
+		for (size_t k = first; k < out.size(); k++)
+			out[k].front_always = true;
+		return all;
+	}
+
 
 private:
 	shared_ptr<hittable> object;
@@ -66,6 +223,18 @@ private:
 		return vec3(1.0 / scale.x(), 1.0 / scale.y(), 1.0 / scale.z());
 	}
 
+	ray to_object(const ray& r) const {
+		vec3 inv_scale = inverse(scale_factor);
+		return ray(r.origin() * inv_scale, r.direction() * inv_scale, r.time());
+	}
+
+	void to_world(const ray& unscaled_r, hit_record& rec) const {
+		vec3 normal = unit_vector(rec.normal * inverse(scale_factor));
+
+		rec.p *= scale_factor;
+		rec.set_face_normal(unscaled_r, normal);
+	}
+
 };
 
 class translate : public hittable {
@@ -81,6 +250,15 @@ public:
 		return true;
 	}
 	aabb bounding_box() const override { return bbox; }
+
+	void hit_packet(ray_packet& packet, uint64_t active) const override {
+		hit_packet_through(*this, *object, packet, active, [&](const ray& r) { return ray(r.origin() - offset, r.direction(), r.time()); },
+			[&](const ray&, const ray&, hit_record& rec) { rec.p += offset; });
+	}
+
+	bool triangulate(const placement& place, std::vector<world_triangle>& out) const override {
+		return object->triangulate([&](const point3& p) { return place(p + offset); }, out);
+	}
 private:
 	shared_ptr<hittable> object;
 	vec3 offset;
@@ -128,30 +306,32 @@ public:
 		bbox = aabb(min, max);
 	}
 	bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-		point3 origin = r.origin();
-		origin = inverse_transform(origin);
-
-		vec3 direction = r.direction();
-		direction = inverse_transform(direction);
-
-		ray rotated_r(origin, direction, r.time());
+		ray rotated_r = to_object(r);
 
 		if (!object->hit(rotated_r, ray_t, rec))
 			return false;
 
-		point3 p = rec.p;
-		vec3 normal = rec.normal;
-
-		p = transform(p);
-		normal = transform(normal);
-
-		rec.p = p;
-		rec.set_face_normal(rotated_r, normal);
-
+		to_world(r, rec);
 		return true;
 	}
 
+	void hit_packet(ray_packet& packet, uint64_t active) const override {
+		hit_packet_through(*this, *object, packet, active, [&](const ray& r) { return to_object(r); },
+			[&](const ray& r, const ray&, hit_record& rec) { to_world(r, rec); });
+	}
+
 	aabb bounding_box() const override { return bbox; }
+
+	/*Where the wrapped object's point p ends up*/
+	point3 rotated(const point3& p) const { return transform(p.x(), p.y(), p.z()); }
+
+	bool triangulate(const placement& place, std::vector<world_triangle>& out) const override {
+		size_t first = out.size();
+		bool all = object->triangulate([&](const point3& p) { return place(rotated(p)); }, out);
+		for (size_t k = first; k < out.size(); k++)
+			out[k].front_always = true;
+		return all;
+	}
 private:
 	shared_ptr<hittable> object;
 	double sin_x, sin_y, sin_z, cos_x, cos_y, cos_z;
@@ -180,21 +360,22 @@ private:
 		return transform(v.x(), v.y(), v.z());
 	}
 
+	/*Undoes transform, so the rotations run in reverse order*/
 	vec3 inverse_transform(double x, double y, double z) const {
-		// rotate x
-		double tmp_x = x;
-		double tmp_y = cos_x * y - sin_x * z;
-		double tmp_z = sin_x * y + cos_x * z;
+		// Rotate about z axis
+		double tmp_x = cos_z * x - sin_z * y;
+		double tmp_y = sin_z * x + cos_z * y;
+		double tmp_z = z;
 
 		// rotate y axis
 		x = cos_y * tmp_x - sin_y * tmp_z;
 		y = tmp_y;
 		z = sin_y * tmp_x + cos_y * tmp_z;
 
-		// Rotate about z axis
-		tmp_x = cos_z * x - sin_z * y;
-		tmp_y = sin_z * x + cos_z * y;
-		tmp_z = z;
+		// rotate x
+		tmp_x = x;
+		tmp_y = cos_x * y - sin_x * z;
+		tmp_z = sin_x * y + cos_x * z;
 
 		return vec3(tmp_x, tmp_y, tmp_z);
 	}
@@ -202,6 +383,27 @@ private:
 	vec3 inverse_transform(vec3& v) const {
 		return inverse_transform(v.x(), v.y(), v.z());
 	}
+
+	ray to_object(const ray& r) const {
+		point3 origin = r.origin();
+		origin = inverse_transform(origin);
+
+		vec3 direction = r.direction();
+		direction = inverse_transform(direction);
+
+		return ray(origin, direction, r.time());
+	}
+
+	void to_world(const ray& r, hit_record& rec) const {
+		point3 p = rec.p;
+		vec3 normal = rec.normal;
+
+		p = transform(p);
+		normal = transform(normal);
+
+		rec.p = p;
+		rec.set_face_normal(r, normal);
+	}
 };
 
 class flip_face : public hittable {
@@ -45,6 +45,20 @@ public:
 	
 	aabb bounding_box() const override { return bbox; }
 
+	/*Skips the objects the whole packet misses by their bounding boxes*/
+	void hit_packet(ray_packet& packet, uint64_t active) const override {
+		for (const auto& object : objects)
+			if (!packet.misses(object->bounding_box(), active))
+				object->hit_packet(packet, active);
+	}
+
+	bool triangulate(const placement& place, std::vector<world_triangle>& out) const override {
+		for (const auto& object : objects)
+			if (!object->triangulate(place, out))
+				return false;
+		return true;
+	}
+
 	double pdf_value(const point3& origin, const vec3& direction) const override {
 		double weight = 1.0 / objects.size();
 		double sum = 0.0;
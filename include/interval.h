@@ -48,4 +48,12 @@ interval operator+(double displacement, const interval& ival) {
 	return ival + displacement;
 }
 
+interval operator*(const interval& ival, double factor) {
+	return factor >= 0 ? interval(ival.min * factor, ival.max * factor) : interval(ival.max * factor, ival.min * factor);
+}
+
+interval operator*(double factor, const interval& ival) {
+	return ival * factor;
+}
+
 #endif // INTERVAL_H
\ No newline at end of file
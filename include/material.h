@@ -3,21 +3,91 @@
 
 #include "hittable.h"
 #include "pdf.h"
+#include "polarization.h"
 #include "texture.h"
 
+#include <atomic>
+#include <typeinfo>
+
 class scatter_record {
 public: 
     color attenuation;
     shared_ptr<pdf> pdf_ptr;
     bool skip_pdf;
     ray skip_pdf_ray;
+
+    /*Sets pdf_ptr to a P made from args, overwriting the P already there when nothing else holds it*/
+    template <typename P, typename... Args>
+    void set_pdf(Args&&... args) {
+        if (pdf_ptr && pdf_ptr.use_count() == 1 && typeid(*pdf_ptr) == typeid(P))
+            *static_cast<P*>(pdf_ptr.get()) = P(std::forward<Args>(args)...);
+        else
+            pdf_ptr = make_shared<P>(std::forward<Args>(args)...);
+    }
+};
+
+
+/*The outcome of one scattering event for every band at once, see material::scatter_bands*/
+class band_scatter {
+public:
+    color emission[BAND_COUNT];
+    color weight[BAND_COUNT];       // Per band attenuation divided by the probability of the sampled lobe
+    bool scattered;
+    scatter_record srec;            // Direction sampling shared by all bands; srec.attenuation is unused
 };
 
+/*A surface's parameters for the analytic facet backscatter model, see material::facet*/
+class facet_params {
+public:
+    color diffuse[BAND_COUNT];      // Albedo of the Lambertian part
+    color specular[BAND_COUNT];     // Albedo of the specular part
+    double slope[BAND_COUNT];       // RMS facet slope of the specular part
+
+    void set(const color& d, const color& s, double rms_slope) {
+        for (int b = 0; b < BAND_COUNT; b++) {
+            diffuse[b] = d;
+            specular[b] = s;
+            slope[b] = rms_slope;
+        }
+    }
+
+    /*
+    Scattering coefficients, radar cross section per unit area, of the Lambertian and specular parts at
+    a surface with normal n from unit direction `in` (toward the source) to `out`. The Lambertian part
+    scatters 4 * albedo * cos_i * cos_o; the specular part follows the geometric optics model of Gaussian
+    facet slopes s, albedo * exp(-tan^2 b / 2s^2) / (2s^2 cos^4 b), b being the angle between n and the
+    half vector of in and out. Slopes below 0.02 are taken as 0.02 to keep mirrors finite.
+    */
+    void scattering(const vec3& n, const vec3& in, const vec3& out, color (&d)[BAND_COUNT], color (&s)[BAND_COUNT]) const {
+        double cos_i = dot(n, in), cos_o = dot(n, out);
+        double cos_b = std::max(dot(n, unit_vector(in + out)), 1e-6);
+        double tan2_b = (1 - cos_b * cos_b) / (cos_b * cos_b);
+        for (int b = 0; b < BAND_COUNT; b++) {
+            double s2 = std::max(slope[b], 0.02);
+            s2 *= s2;
+            d[b] = 4 * cos_i * cos_o * diffuse[b];
+            s[b] = std::exp(-tan2_b / (2 * s2)) / (2 * s2 * cos_b * cos_b * cos_b * cos_b) * specular[b];
+        }
+    }
+};
 
 class material {
 public:
     virtual ~material() = default;
 
+    /*
+    Samples one scattering event shared by all bands. Materials that behave the same in every band
+    use the default, which is a single scatter() call.
+    */
+    virtual void scatter_bands(const ray& r_in, const hit_record& rec, band_scatter& bs) const {
+        color emission = emitted(r_in, rec, rec.u, rec.v, rec.p);
+        bs.scattered = scatter(r_in, rec, bs.srec);
+        for (int b = 0; b < BAND_COUNT; b++) {
+            bs.emission[b] = emission;
+            bs.weight[b] = bs.srec.attenuation;
+        }
+    }
+
     virtual color emitted(const ray& r_in, const hit_record& rec, double u, double v, const point3& p) const {
         return color(0., 0., 0.);
     }
@@ -29,9 +99,39 @@ public:
     }
 
     virtual double scattering_pdf(const ray& r_in, const hit_record& rec, const ray& scattered) const { return 0; }
+
+    /*The material that shades hits on this one: itself, or what a stand-in such as material_slot points to*/
+    virtual const material* resolve() const { return this; }
+
+    /*
+    Carries a path's polarization (see polarization.h) across a scatter into `scattered`: specular events
+    (skip_pdf) reflect or transmit the field, and lobes sampled from a pdf depolarize it.
+    */
+    virtual void polarize(const ray& r_in, const hit_record& rec, const scatter_record& srec, const vec3& scattered, vec3& field) const {
+        field = srec.skip_pdf ? specular_field(field, r_in.direction(), rec.normal, scattered) : depolarized_field(scattered);
+    }
+
+    /*
+    Expected weight of the material's mirror reflection in each band, the lobe's probability times its
+    albedo, for the deterministic SBR tracer (see camera::trace_mirror_returns). Zero when its specular
+    events are not mirror reflections, which leaves them to Monte Carlo.
+    */
+    virtual void mirror_weights(const hit_record& rec, color (&weight)[BAND_COUNT]) const {
+        for (int b = 0; b < BAND_COUNT; b++)
+            weight[b] = color(0, 0, 0);
+    }
+
+    /*
+    The surface as the facet backscatter preview sees it (see camera::trace_facet): diffuse and specular
+    albedo per band, and the specular part's roughness as an RMS facet slope. A fuzz of f spreads mirror
+    reflections about f radians, which a facet slope of f / 2 does too. Zero for non-scattering materials.
+    */
+    virtual void facet(const hit_record& rec, facet_params& f) const {
+        f.set(color(0, 0, 0), color(0, 0, 0), 0.0);
+    }
 };
 
-class lambertian : public material {
+class lambertian final : public material {
 public: 
     lambertian(const color& albedo) : tex(make_shared<solid_color>(albedo)) {}
     lambertian(shared_ptr<texture> tex) : tex(tex) {}
@@ -40,7 +140,7 @@ public:
         const ray& r_in, const hit_record& rec, scatter_record& srec
     ) const override {
         srec.attenuation = tex->value(rec.u, rec.v, rec.p);
-        srec.pdf_ptr = make_shared<cosine_pdf>(rec.normal);
+        srec.set_pdf<cosine_pdf>(rec.normal);
         srec.skip_pdf = false;
         return true;
     }
@@ -50,12 +150,16 @@ public:
         return cos_theta < 0 ? 0 : cos_theta / pi;
     }
 
+    void facet(const hit_record& rec, facet_params& f) const override {
+        f.set(tex->value(rec.u, rec.v, rec.p), color(0, 0, 0), 0.0);
+    }
+
 private:
     shared_ptr<texture> tex;
 };
 
 
-class metal : public material {
+class metal final : public material {
 public:
     metal(const color& albedo, double fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
 
@@ -73,12 +177,21 @@ public:
         return true;
     }
 
+    void mirror_weights(const hit_record& rec, color (&weight)[BAND_COUNT]) const override {
+        for (int b = 0; b < BAND_COUNT; b++)
+            weight[b] = albedo;
+    }
+
+    void facet(const hit_record& rec, facet_params& f) const override {
+        f.set(color(0, 0, 0), albedo, fuzz / 2);
+    }
+
 private:
     color albedo;
     double fuzz;
 };
 
-class glossy : public material {
+class glossy final : public material {
 public:
     // Fuzz texture interpreted as the magnitude of the fuzz texture.
     glossy(shared_ptr<texture> a, shared_ptr<texture> f) : albedo(a), fuzz(f) {}
@@ -96,12 +209,16 @@ public:
         srec.pdf_ptr = 0;
         return true;
     }
+
+    void facet(const hit_record& rec, facet_params& f) const override {
+        f.set(color(0, 0, 0), albedo->value(rec.u, rec.v, rec.p), fuzz->value(rec.u, rec.v, rec.p).length() / 2);
+    }
 public:
     shared_ptr<texture> albedo, fuzz;
 };
 
 // This is a combination of lambertian and glossy
-class medium : public material {
+class medium final : public material {
 public:
     // Fuzz texture interpreted as the magnitude of the fuzz texture.
     medium(const color& albedo, const double fuzz) : albedo(make_shared<solid_color>(albedo)), fuzz(make_shared<solid_color>(color(fuzz, fuzz, fuzz))) {}
@@ -116,7 +233,7 @@ public:
         srec.attenuation = albedo->value(rec.u, rec.v, rec.p);
         // Above ratio chooses between the lambertian (diffuse) reflection
         if (random_double() > ratio) {
-            srec.pdf_ptr = make_shared<cosine_pdf>(rec.normal);
+            srec.set_pdf<cosine_pdf>(rec.normal);
             srec.skip_pdf = false;
             return true;
         }
@@ -137,12 +254,22 @@ public:
             double cos_theta = dot(rec.normal, unit_vector(scattered.direction()));
             return cos_theta < 0 ? 0 : cos_theta / pi;
         }
+
+    void mirror_weights(const hit_record& rec, color (&weight)[BAND_COUNT]) const override {
+        for (int b = 0; b < BAND_COUNT; b++)
+            weight[b] = ratio * albedo->value(rec.u, rec.v, rec.p);
+    }
+
+    void facet(const hit_record& rec, facet_params& f) const override {
+        color a = albedo->value(rec.u, rec.v, rec.p);
+        f.set((1 - ratio) * a, ratio * a, fuzz->value(rec.u, rec.v, rec.p).length() / 2);
+    }
 public:
     shared_ptr<texture> albedo, fuzz;
     double ratio;
 };
 
-class dielectric : public material {
+class dielectric final : public material {
 public:
     dielectric(double refraction_index) : refraction_index(refraction_index) {}
 
@@ -170,7 +297,10 @@ public:
         return true;
     }
 
-    
+    void facet(const hit_record& rec, facet_params& f) const override {
+        double r = reflectance(1.0, refraction_index);
+        f.set(color(0, 0, 0), color(r, r, r), 0.0);
+    }
 
 private:
     // Refractive index in vacuum or air, or the ratio of the material's refractive index over
@@ -186,7 +316,7 @@ private:
     }
 };
 
-class diffuse_light : public material {
+class diffuse_light final : public material {
 public:
     diffuse_light(shared_ptr<texture> tex) : tex(tex) {}
     diffuse_light(const color& emit) : tex(make_shared<solid_color>(emit)) {}
@@ -234,7 +364,7 @@ public:
         else {
             //std::clog << "hit: " << rec.p << "\n";
             //std::clog << "test: " << test << "\n";
-            return tex->value(u, v, p) * std::pow(cos_theta, sharpness);
+            return tex->value(u, v, p) * std::pow(test, sharpness);
         }
         
     }
@@ -250,7 +380,7 @@ private:
     }*/
 };
 
-class isotropic : public material {
+class isotropic final : public material {
 public:
     isotropic(const color& albedo) : tex(make_shared<solid_color>(albedo)) {}
 
@@ -260,7 +390,7 @@ public:
         const ray& r_in, const hit_record& rec, scatter_record& srec
     ) const override {
         srec.attenuation = tex->value(rec.u, rec.v, rec.p);
-        srec.pdf_ptr = make_shared<sphere_pdf>();
+        srec.set_pdf<sphere_pdf>();
         srec.skip_pdf = false;
         return true;
     }
@@ -269,6 +399,10 @@ public:
         return 1 / (4 * pi);
     }
 
+    void facet(const hit_record& rec, facet_params& f) const override {
+        f.set(tex->value(rec.u, rec.v, rec.p), color(0, 0, 0), 0.0);
+    }
+
 private: 
     shared_ptr<texture> tex;
 };
@@ -285,7 +419,7 @@ private:
 //
 // sharpness map: remapped to fuzz := 1-log_10(sharpness)/4, sharpness clamped to [1, 10000]
 //
-class mtl_material : public material {
+class mtl_material final : public material {
 public:
     mtl_material(
         shared_ptr<texture> diffuse_a,
@@ -299,7 +433,8 @@ public:
         diffuse_text(diffuse_a),
         specular_text(specular_a),
         transparency_text(transparency_map),
-        roughness_text(make_shared<roughness_from_sharpness_texture>(sharpness_map, 1, 10000))
+        roughness_text(make_shared<roughness_from_sharpness_texture>(sharpness_map, 1, 10000)),
+        alpha(alpha)
     {
         diffuse_mat = make_shared<lambertian>(diffuse_text);
         specular_mat = make_shared<medium>(specular_text, roughness_text, alpha);
@@ -328,6 +463,53 @@ public:
         return emissive_mat->emitted(r_in, rec, u, v, p);
     }
 
+    /*
+    scatter() as lobe probabilities: pass through (transparent), cosine-weighted (the lambertian and the
+    diffuse half of the medium) and fuzzy mirror reflection. Weights are probability times albedo.
+    */
+    struct lobes {
+        double transparent, cosine, specular;
+        color cosine_weight, specular_weight;
+    };
+
+    lobes lobe_split(double u, double v, const point3& p) const {
+        double t = transparency_prob(u, v, p);
+        double d = diffuse_prob(u, v, p);
+        double ratio = std::clamp(alpha, 0.0, 1.0);
+        color diffuse = diffuse_text->value(u, v, p);
+        color specular = specular_text->value(u, v, p);
+
+        lobes l;
+        l.transparent = t;
+        l.cosine = (1 - t) * (d + (1 - d) * (1 - ratio));
+        l.specular = (1 - t) * (1 - d) * ratio;
+        l.cosine_weight = (1 - t) * (d * diffuse + (1 - d) * (1 - ratio) * specular);
+        l.specular_weight = l.specular * specular;
+        return l;
+    }
+
+    void mirror_weights(const hit_record& rec, color (&weight)[BAND_COUNT]) const override {
+        color specular = lobe_split(rec.u, rec.v, rec.p).specular_weight;
+        for (int b = 0; b < BAND_COUNT; b++)
+            weight[b] = specular;
+    }
+
+    void facet(const hit_record& rec, facet_params& f) const override {
+        lobes l = lobe_split(rec.u, rec.v, rec.p);
+        f.set(l.cosine_weight, l.specular_weight, roughness(rec) / 2);
+    }
+
+    /*Fuzz of the specular lobe*/
+    double roughness(const hit_record& rec) const {
+        return roughness_text->value(rec.u, rec.v, rec.p).length();
+    }
+
+    /*Direction of the specular lobe, as sampled by medium*/
+    vec3 specular_direction(const ray& r_in, const hit_record& rec) const {
+        vec3 reflected = reflect(r_in.direction(), rec.normal);
+        return unit_vector(reflected) + (roughness(rec) * random_unit_vector());
+    }
+
     virtual double scattering_pdf(
         const ray& r_in, const hit_record& rec, const ray& scattered) const override {
         // We don't need to care about the transparent case, this only integrates over scattered rays (note specular are scatterd, but not diffuse)
@@ -339,6 +521,7 @@ public:
     shared_ptr<texture> emissive_text, diffuse_text, specular_text, transparency_text, roughness_text;
 private:
     shared_ptr<material> emissive_mat, diffuse_mat, specular_mat;
+    double alpha;
     inline double transparency_prob(double u, double v, const point3& p) const {
         double diff = diffuse_text->value(u, v, p).length();
         double spec = specular_text->value(u, v, p).length();
@@ -362,5 +545,135 @@ private:
     }
 };
 
+// One mtl_material per band (see SPECTRUM) for single-pass multi-band rendering. Each event picks a lobe
+// with the probability averaged over the bands and weights every band by its own probability of that
+// lobe, so all bands follow one path while each stays an unbiased estimate of its own render.
+// Used as a plain material it behaves as its VISIBLE band.
+class band_material : public material {
+public:
+    band_material(const shared_ptr<mtl_material> (&materials)[BAND_COUNT]) {
+        for (int b = 0; b < BAND_COUNT; b++)
+            bands[b] = materials[b];
+    }
+
+    bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
+        return bands[VISIBLE]->scatter(r_in, rec, srec);
+    }
+
+    color emitted(const ray& r_in, const hit_record& rec, double u, double v, const point3& p) const override {
+        return bands[VISIBLE]->emitted(r_in, rec, u, v, p);
+    }
+
+    double scattering_pdf(const ray& r_in, const hit_record& rec, const ray& scattered) const override {
+        // Only the cosine lobe is sampled with a pdf
+        double cos_theta = dot(rec.normal, unit_vector(scattered.direction()));
+        return cos_theta < 0 ? 0 : cos_theta / pi;
+    }
+
+    void scatter_bands(const ray& r_in, const hit_record& rec, band_scatter& bs) const override {
+        mtl_material::lobes lobes[BAND_COUNT];
+        double cosine = 0.0, specular = 0.0;
+        for (int b = 0; b < BAND_COUNT; b++) {
+            lobes[b] = bands[b]->lobe_split(rec.u, rec.v, rec.p);
+            cosine += lobes[b].cosine / BAND_COUNT;
+            specular += lobes[b].specular / BAND_COUNT;
+            bs.emission[b] = bands[b]->emitted(r_in, rec, rec.u, rec.v, rec.p);
+        }
+
+        double choice = random_double();
+        if (choice < cosine) {
+            for (int b = 0; b < BAND_COUNT; b++)
+                bs.weight[b] = lobes[b].cosine_weight / cosine;
+            bs.srec.set_pdf<cosine_pdf>(rec.normal);
+            bs.srec.skip_pdf = false;
+            bs.scattered = true;
+        }
+        else if (choice < cosine + specular) {
+            for (int b = 0; b < BAND_COUNT; b++)
+                bs.weight[b] = lobes[b].specular_weight / specular;
+            bs.srec.pdf_ptr = nullptr;
+            bs.srec.skip_pdf = true;
+            bs.srec.skip_pdf_ray = ray(rec.p, bands[VISIBLE]->specular_direction(r_in, rec), r_in.time());
+            bs.scattered = true;
+        }
+        else {
+            bs.scattered = false;   // Transparent, which mtl_material treats as absorbed
+        }
+    }
+
+    void mirror_weights(const hit_record& rec, color (&weight)[BAND_COUNT]) const override {
+        for (int b = 0; b < BAND_COUNT; b++)
+            weight[b] = bands[b]->lobe_split(rec.u, rec.v, rec.p).specular_weight;
+    }
+
+    void facet(const hit_record& rec, facet_params& f) const override {
+        for (int b = 0; b < BAND_COUNT; b++) {
+            mtl_material::lobes l = bands[b]->lobe_split(rec.u, rec.v, rec.p);
+            f.diffuse[b] = l.cosine_weight;
+            f.specular[b] = l.specular_weight;
+            f.slope[b] = bands[b]->roughness(rec) / 2;
+        }
+    }
+
+private:
+    shared_ptr<mtl_material> bands[BAND_COUNT];
+};
+
+/*Band the calling thread is shading, BAND_COUNT meaning all bands at once. Read by material_slot.*/
+inline thread_local int shading_band = X;
+
+// A stable stand-in for a material that can be swapped while the geometry referencing it stays built.
+// Each band (plus BAND_COUNT for band_material) has its own entry, picked by shading_band, so views in
+// different bands can render the same BVH at the same time. Entries are published by material_table,
+// which keeps every material it ever published alive.
+class material_slot : public material {
+public:
+    void publish(int band, const material* m) { entries[band].store(m, std::memory_order_release); }
+
+    bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
+        return current()->scatter(r_in, rec, srec);
+    }
+
+    color emitted(const ray& r_in, const hit_record& rec, double u, double v, const point3& p) const override {
+        return current()->emitted(r_in, rec, u, v, p);
+    }
+
+    double scattering_pdf(const ray& r_in, const hit_record& rec, const ray& scattered) const override {
+        return current()->scattering_pdf(r_in, rec, scattered);
+    }
+
+    void scatter_bands(const ray& r_in, const hit_record& rec, band_scatter& bs) const override {
+        current()->scatter_bands(r_in, rec, bs);
+    }
+
+    void polarize(const ray& r_in, const hit_record& rec, const scatter_record& srec, const vec3& scattered, vec3& field) const override {
+        current()->polarize(r_in, rec, srec, scattered, field);
+    }
+
+    void mirror_weights(const hit_record& rec, color (&weight)[BAND_COUNT]) const override {
+        current()->mirror_weights(rec, weight);
+    }
+
+    void facet(const hit_record& rec, facet_params& f) const override {
+        current()->facet(rec, f);
+    }
+
+    const material* resolve() const override {
+        return current()->resolve();
+    }
+
+private:
+    std::atomic<const material*> entries[BAND_COUNT + 1] = {};
+
+    const material* current() const {
+        const material* m = entries[shading_band].load(std::memory_order_acquire);
+        if (!m) {
+            std::cerr << "Material table for band " << shading_band << " was not prepared" << std::endl;
+            exit(-1);
+        }
+        return m;
+    }
+};
+
 
 #endif // MATERIAL_H
\ No newline at end of file
@@ -0,0 +1,139 @@
+#ifndef MATERIAL_TABLE_H
+#define MATERIAL_TABLE_H
+
+/*
+* Per-band material tables for a loaded mesh.
+*
+* Triangles are built against one material_slot per .mtl material. Each band's table is converted once
+* from the mesh's .mtl materials, and changing an RMS height (or reloading the roughness database)
+* re-converts only the affected materials, so band switches and roughness tuning never re-parse the .obj
+* or rebuild a BVH.
+*/
+
+#include "material.h"
+#include "model.h"
+#include "obj_loader.h"
+#include "roughness_db.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class material_table {
+public:
+	static const int ALL_BANDS = BAND_COUNT;	// The band_material table used for single-pass multi-band renders
+
+	material_table(const std::vector<tinyobj::material_t>& materials, shared_ptr<const roughness_db> db) : materials(materials), db(db) {
+		for (size_t m = 0; m < materials.size(); m++) {
+			auto slot = make_shared<material_slot>();
+			slot_entries.push_back(slot);
+			slot_materials.push_back(slot);
+		}
+		for (int band = 0; band <= ALL_BANDS; band++) {
+			live[band].resize(materials.size());
+			replaced[band].resize(materials.size());
+		}
+	}
+
+	/*Stable per-material proxies, in .mtl order, to build triangles against (see build_model)*/
+	const std::vector<shared_ptr<material>>& slots() const { return slot_materials; }
+
+	/*Converts and publishes the table for a band, or ALL_BANDS, unless it is already built*/
+	void prepare(int band) {
+		std::lock_guard<std::mutex> lock(edit_mutex);
+		if (prepared[band])
+			return;
+		trace_scope table_span("material_table", "build", band == ALL_BANDS ? "ALL" : band_name(SPECTRUM(band)));
+		for (size_t m = 0; m < materials.size(); m++)
+			publish(m, band);
+		prepared[band] = true;
+	}
+
+	/*Overrides a material's RMS height (meters) and rebuilds it in every prepared table*/
+	void set_rms(const std::string& name, double rms_height) {
+		std::lock_guard<std::mutex> lock(edit_mutex);
+		rms_overrides[name] = rms_height;
+		for (size_t m = 0; m < materials.size(); m++) {
+			if (materials[m].name != name)
+				continue;
+			for (int band = 0; band <= ALL_BANDS; band++)
+				if (prepared[band])
+					publish(m, band);
+		}
+	}
+
+	/*
+	Switches to a reloaded roughness database, re-converting the materials whose height changed in a
+	prepared band. Returns how many materials were re-converted.
+	*/
+	size_t set_database(shared_ptr<const roughness_db> new_db) {
+		std::lock_guard<std::mutex> lock(edit_mutex);
+		shared_ptr<const roughness_db> old_db = db;
+		db = new_db;
+
+		size_t rebuilt = 0;
+		for (size_t m = 0; m < materials.size(); m++) {
+			bool changed[BAND_COUNT];
+			for (int b = 0; b < BAND_COUNT; b++) {
+				const double* before = rms(materials[m].name, SPECTRUM(b), *old_db);
+				const double* after = rms(materials[m].name, SPECTRUM(b), *new_db);
+				changed[b] = (before == nullptr) != (after == nullptr) || (before && *before != *after);
+			}
+
+			bool any = false;
+			for (int band = 0; band <= ALL_BANDS; band++) {
+				bool band_changed = band == ALL_BANDS ? changed[0] || changed[1] || changed[2] || changed[3] : changed[band];
+				if (prepared[band] && band_changed) {
+					publish(m, band);
+					any = true;
+				}
+			}
+			rebuilt += any;
+		}
+		return rebuilt;
+	}
+
+private:
+	std::vector<tinyobj::material_t> materials;
+	shared_ptr<const roughness_db> db;
+	std::vector<shared_ptr<material_slot>> slot_entries;
+	std::vector<shared_ptr<material>> slot_materials;
+	std::map<std::string, double> rms_overrides;
+	bool prepared[ALL_BANDS + 1] = {};
+	// What each slot publishes per band, and the generation it replaced. A shading call may still be using
+	// the replaced one, so it is freed only when the next reload replaces it in turn.
+	std::vector<shared_ptr<material>> live[ALL_BANDS + 1];
+	std::vector<shared_ptr<material>> replaced[ALL_BANDS + 1];
+	std::mutex edit_mutex;
+
+	/*The RMS height for a material in a band: a set_rms override, else the database's, else nullptr*/
+	const double* rms(const std::string& name, SPECTRUM band, const roughness_db& from) const {
+		auto overridden = rms_overrides.find(name);
+		if (overridden != rms_overrides.end())
+			return &overridden->second;
+		return from.find(name, band);
+	}
+
+	shared_ptr<mtl_material> convert(size_t m, SPECTRUM band) const {
+		return get_mtl_mat(materials[m], SPECTRAL_MAP.find(band)->second, rms(materials[m].name, band, *db));
+	}
+
+	void publish(size_t m, int band) {
+		shared_ptr<material> converted;
+		if (band == ALL_BANDS) {
+			shared_ptr<mtl_material> bands[BAND_COUNT];
+			for (int b = 0; b < BAND_COUNT; b++)
+				bands[b] = convert(m, SPECTRUM(b));
+			converted = make_shared<band_material>(bands);
+		}
+		else {
+			converted = convert(m, SPECTRUM(band));
+		}
+		slot_entries[m]->publish(band, converted.get());
+		replaced[band][m] = std::move(live[band][m]);
+		live[band][m] = std::move(converted);
+	}
+};
+
+#endif // MATERIAL_TABLE_H
@@ -1,35 +1,38 @@
 #ifndef MODEL_H
 #define MODEL_H
 
-#include "triangle.h"
-#include "hittable_list.h"
-#include "material.h"
-#include <string>
-
-struct mesh {
-	mesh(std::vector<vec3>& vert, std::vector<unsigned int>& ind) {
-		vertices = vert;
-		indices = ind;
-	}
+/*
+* Parsed .obj geometry, kept independent of materials and acceleration structures so it can be
+* cached (see scene.h) and rebuilt into triangles without touching the .obj file again.
+*/
 
-	std::vector<vec3> vertices;
-	std::vector<unsigned int> indices;
-};
+#include "aabb.h"
 
-class model {
-public:
-	model(const std::string& path, double scale = 1.0, std::shared_ptr<material> mat = make_shared<lambertian>(vec3(0, 0, 0))) : scale(scale), mat(mat)
-	{
-	}
+#include <cstdint>
+#include <string>
+#include <vector>
 
-private:
-	std::string directory;
-	std::vector<mesh> meshes;
-	std::shared_ptr<material> mat;
-	double scale;
+struct mesh_face {
+	uint32_t v[3];		// Indices into mesh::positions
+	int32_t n[3];		// Indices into mesh::normals, -1 when the vertex has no normal
+	int32_t material;	// Index into mesh::materials, -1 to use the model's fallback material
+};
 
+struct mesh_shape {
+	std::string name;
+	size_t first_face;
+	size_t face_count;
+};
 
-	
+struct mesh {
+	std::vector<double> positions;	// xyz triplets, normalized to [-1, 1] on the longest axis
+	std::vector<double> normals;	// xyz triplets
+	std::vector<mesh_face> faces;
+	std::vector<mesh_shape> shapes;
+	std::vector<tinyobj::material_t> materials;
+
+	point3 position(uint32_t i) const { return point3(positions[3 * i], positions[3 * i + 1], positions[3 * i + 2]); }
+	vec3 normal(int32_t i) const { return vec3(normals[3 * i], normals[3 * i + 1], normals[3 * i + 2]); }
 };
 
-#endif // MODEL_H
\ No newline at end of file
+#endif // MODEL_H
@@ -12,18 +12,26 @@ Original code by Drummersbrother at https://github.com/Drummersbrother/raytracin
 
 #include "../external/tiny_obj_loader.h"
 
+#include <functional>
 #include <stdio.h>
 
 
 #include "bvh.h"
 #include "material.h"
+#include "model.h"
+#include "roughness_db.h"
+#include "trace.h"
 #include "triangle.h"
 
 color _get_color(tinyobj::real_t* raws) {
 	return color(raws[0], raws[1], raws[2]);
 }
 
-shared_ptr<material> get_mtl_mat(const tinyobj::material_t& reader_mat, double wavelength) {
+/*
+Converts an .mtl material for one wavelength. With a wavelength and an RMS surface height (meters) the
+colors come from the smooth / slightly rough / rough classification; otherwise the .mtl colors are kept.
+*/
+shared_ptr<mtl_material> get_mtl_mat(const tinyobj::material_t& reader_mat, double wavelength, const double* rms_height) {
 	shared_ptr<texture> diffuse_a;
 	shared_ptr<texture> specular_a;
 	shared_ptr<texture> emissive_a;
@@ -32,32 +40,27 @@ shared_ptr<material> get_mtl_mat(const tinyobj::material_t& reader_mat, double w
 	
 	//std::clog << "Parsing material: " << reader_mat.name << std::endl;
 	
-	if (wavelength > 0.0) {
-		auto search = tex_map.find(reader_mat.name);
-		if (search != tex_map.end()) {
-			std::clog << "Adjusting colors for: " << reader_mat.name << std::endl;
-			double rms_height = tex_map.find(reader_mat.name)->second;
-			double alpha_spec = 0.0;
-			if (rms_height < (wavelength / 32.0)) { // Smooth
-				diffuse_a = make_shared<solid_color>(color(0.05, 0.05, 0.05));  specular_a= make_shared<solid_color>(color(1.0, 1.0, 1.0)); 
-				alpha_spec = 1.0;
-			}
-			else if (rms_height > wavelength / 2.0) { // Rough
-				diffuse_a = make_shared<solid_color>(color(0.3, 0.3, 0.3)); specular_a = make_shared<solid_color>(color(0.05, 0.05, 0.05));
-				alpha_spec = 0.0;
-			}
-			else {	// Slightly Rough
-				double min = wavelength / 32.0;
-				double max = wavelength / 2.0;
-				alpha_spec = (rms_height - min) / (max - min);
-				
-				diffuse_a = make_shared<solid_color>(color(0.2 * (1 - alpha_spec))); specular_a = make_shared<solid_color>(color(0.6 * alpha_spec));
-			}
+	if (wavelength > 0.0 && rms_height) {
+		double alpha_spec = 0.0;
+		if (*rms_height < (wavelength / 32.0)) { // Smooth
+			diffuse_a = make_shared<solid_color>(color(0.05, 0.05, 0.05));  specular_a= make_shared<solid_color>(color(1.0, 1.0, 1.0)); 
+			alpha_spec = 1.0;
+		}
+		else if (*rms_height > wavelength / 2.0) { // Rough
+			diffuse_a = make_shared<solid_color>(color(0.3, 0.3, 0.3)); specular_a = make_shared<solid_color>(color(0.05, 0.05, 0.05));
+			alpha_spec = 0.0;
+		}
+		else {	// Slightly Rough
+			double min = wavelength / 32.0;
+			double max = wavelength / 2.0;
+			alpha_spec = (*rms_height - min) / (max - min);
+			
+			diffuse_a = make_shared<solid_color>(color(0.2 * (1 - alpha_spec))); specular_a = make_shared<solid_color>(color(0.6 * alpha_spec));
 		}
-		else
-			std::clog << reader_mat.name << std::endl;
 	}
 	else {
+		if (wavelength > 0.0)
+			std::clog << "No RMS height for " << reader_mat.name << ", keeping its .mtl colors" << std::endl;
 		diffuse_a = make_shared<solid_color>(_get_color((tinyobj::real_t*)reader_mat.diffuse));
 		specular_a = make_shared<solid_color>(_get_color((tinyobj::real_t*)reader_mat.specular));
 	}
@@ -77,19 +80,36 @@ shared_ptr<material> get_mtl_mat(const tinyobj::material_t& reader_mat, double w
 	);
 }
 
-shared_ptr<hittable> load_model_from_file(std::string filename, shared_ptr<material> model_material, double wavelength) {
+/*get_mtl_mat with the RMS height from the current roughness database*/
+shared_ptr<mtl_material> get_mtl_mat(const tinyobj::material_t& reader_mat, double wavelength) {
+	// Band overrides apply when the wavelength is exactly one of the named bands
+	SPECTRUM band = X;
+	for (const auto& [b, band_wavelength] : SPECTRAL_MAP)
+		if (band_wavelength == wavelength)
+			band = b;
+
+	shared_ptr<const roughness_db> db = roughness_registry::current();
+	const double* rms_height = db->find(reader_mat.name, band);
+	if (rms_height && wavelength > 0.0)
+		std::clog << "Adjusting colors for: " << reader_mat.name << std::endl;
+	return get_mtl_mat(reader_mat, wavelength, rms_height);
+}
+
+/*Parses an .obj file (and its .mtl) into a mesh with vertices normalized to [-1, 1]*/
+mesh load_mesh(const std::string& filename) {
 	std::cerr << "Loading .obj file '" << filename << "'." << std::endl;
 
-	std::string inputfile = filename;
 	tinyobj::ObjReaderConfig reader_config;
-
 	tinyobj::ObjReader reader;
 
-	if (!reader.ParseFromFile(inputfile, reader_config)) {
-		if (!reader.Error().empty()) {
-			std::cerr << "TinyObjReader error: " << reader.Error();
+	{
+		trace_scope parse_span("obj_parse", "load", filename);
+		if (!reader.ParseFromFile(filename, reader_config)) {
+			if (!reader.Error().empty()) {
+				std::cerr << "TinyObjReader error: " << reader.Error();
+			}
+			exit(-1);
 		}
-		exit(-1);
 	}
 
 	if (!reader.Warning().empty()) {
@@ -98,83 +118,104 @@ shared_ptr<hittable> load_model_from_file(std::string filename, shared_ptr<mater
 
 	auto& attrib = reader.GetAttrib();
 	auto& shapes = reader.GetShapes();
-	auto& raw_materials = reader.GetMaterials();
-
-	// Convert from TinyObjLoader to RT in a Weekend materials
-	std::vector<shared_ptr<material>> converted_mats;
-	int count = 1;
-	for (auto& raw_mat : raw_materials) {
-		std::clog << "Loading " << count << " of " << raw_materials.size() << " materials.\n" << std::flush ;
-		converted_mats.push_back(get_mtl_mat(raw_mat, wavelength));
-		count++;
-	}
-	std::clog << "Materials loaded" << std::endl;
 
-	const bool use_mtl_file = (raw_materials.size() != 0);
-
-	hittable_list model_output;
+	mesh output;
+	output.materials = reader.GetMaterials();
 
+	trace_scope bbox_span("bounding_box", "load");
 	aabb bbox(shapes, attrib);
+	bbox_span.end();
 	double sx = bbox.x.max - bbox.x.min;
 	double sy = bbox.y.max - bbox.y.min;
 	double sz = bbox.z.max - bbox.z.min;
 
 	double scale = std::max(std::max(sx, sy), sz) / 2.0;
 
-	//std::clog << "aabb size is: (" << bbox.x.min << ", " << bbox.y.min << ", " << bbox.z.min << ") - (" <<
-	//	bbox.x.max << ", " << bbox.y.max << ", " << bbox.z.max << ")\n";
-
-	//std::clog << "Scale is: " << scale << "\n";
+	// Normalize the vertices
+	output.positions.resize(attrib.vertices.size());
+	for (size_t i = 0; i + 2 < attrib.vertices.size(); i += 3) {
+		output.positions[i + 0] = (attrib.vertices[i + 0] - (bbox.x.min + sx / 2.)) / scale;
+		output.positions[i + 1] = (attrib.vertices[i + 1] - (bbox.y.min + sy / 2.)) / scale;
+		output.positions[i + 2] = (attrib.vertices[i + 2] - (bbox.z.min + sz / 2.)) / scale;
+	}
+	output.normals.assign(attrib.normals.begin(), attrib.normals.end());
 
 	for (size_t s = 0; s < shapes.size(); s++) {
-		hittable_list shape_triangles;
+		mesh_shape shape{ shapes[s].name, output.faces.size(), shapes[s].mesh.num_face_vertices.size() };
 
 		size_t index_offset = 0;
 		for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-			const int fv = 3; 
+			const int fv = 3;
 			assert(shapes[s].mesh.num_face_vertices[f] == fv);
 
+			mesh_face face;
+			for (size_t v = 0; v < 3; v++) {
+				tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
+				face.v[v] = uint32_t(idx.vertex_index);
+				face.n[v] = idx.normal_index;
+			}
+			face.material = shapes[s].mesh.material_ids.empty() ? -1 : shapes[s].mesh.material_ids[f];
+			output.faces.push_back(face);
+			index_offset += fv;
+		}
+		output.shapes.push_back(shape);
+	}
+
+	return output;
+}
+
+/*Converts the mesh's .mtl materials for one wavelength, 0 keeping the .mtl colors*/
+std::vector<shared_ptr<material>> convert_materials(const mesh& model, double wavelength) {
+	// Convert from TinyObjLoader to RT in a Weekend materials
+	trace_scope materials_span("materials", "load");
+	std::vector<shared_ptr<material>> converted_mats;
+	int count = 1;
+	for (auto& raw_mat : model.materials) {
+		std::clog << "Loading " << count << " of " << model.materials.size() << " materials.\n" << std::flush;
+		trace_scope mat_span("get_mtl_mat", "load", raw_mat.name);
+		converted_mats.push_back(get_mtl_mat(raw_mat, wavelength));
+		count++;
+	}
+	std::clog << "Materials loaded" << std::endl;
+	return converted_mats;
+}
+
+/*Decides from its vertices whether a face is built, see build_model*/
+using face_filter = std::function<bool(const point3&, const point3&, const point3&)>;
+
+/*
+Converts a parsed mesh into triangles with a BVH per shape, under one top-level BVH. Faces use
+materials[face.material], or model_material when the face has none. When given, `keep` sees every face's
+vertices first and faces it rejects are not built at all; with no faces left the model is an empty list.
+*/
+shared_ptr<hittable> build_model(const mesh& model, const std::vector<shared_ptr<material>>& converted_mats, shared_ptr<material> model_material,
+	const std::string& name = "model", const face_filter& keep = nullptr) {
+	hittable_list model_output;
+
+	for (const mesh_shape& shape : model.shapes) {
+		trace_scope shape_span("shape", "load", shape.name);
+		hittable_list shape_triangles;
+
+		for (size_t f = shape.first_face; f < shape.first_face + shape.face_count; f++) {
+			const mesh_face& face = model.faces[f];
+
 			vec3 tri_v[3];
 			vec3 tri_vn[3];
 			bool has_normals = false;
-			
-			// Loop over vertices in the face
-			//std::clog << "f = " << f << " of " << shapes[s].mesh.num_face_vertices.size() << "\n";
+
 			for (size_t v = 0; v < 3; v++) {
-				tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-				tinyobj::real_t vx = attrib.vertices[3 * std::size_t(idx.vertex_index) + 0];
-				tinyobj::real_t vy = attrib.vertices[3 * std::size_t(idx.vertex_index) + 1];
-				tinyobj::real_t vz = attrib.vertices[3 * std::size_t(idx.vertex_index) + 2];
-				//std::clog << "Made it to line 95\n";
-				//std::clog << "vx: " << vx << " vy: " << vy << " vz: " << vz << "\n";
-
-				// Normalize the vertices
-				vx = (vx - (bbox.x.min + sx / 2.)) / scale;
-				vy = (vy - (bbox.y.min + sy / 2.)) / scale;
-				vz = (vz - (bbox.z.min + sz / 2.)) / scale;
-				tri_v[v] = vec3(vx, vy, vz);
-
-				if (idx.normal_index >= 0) {
+				tri_v[v] = model.position(face.v[v]);
+				if (face.n[v] >= 0) {
 					has_normals = true;
-					tinyobj::real_t nx = attrib.normals[3 * size_t(idx.normal_index) + 0];
-					tinyobj::real_t ny = attrib.normals[3 * size_t(idx.normal_index) + 1];
-					tinyobj::real_t nz = attrib.normals[3 * size_t(idx.normal_index) + 2];
-					//std::clog << "nx: " << nx << " ny: " << ny << " nz: " << nz << "\n";
-					//std::clog << "Made it to line 102\n";
-					tri_vn[v] = vec3(nx, ny, nz);
-				}
-				else {
-					continue;
+					tri_vn[v] = model.normal(face.n[v]);
 				}
 			}
-			shared_ptr<material> tri_mat;
-			if (use_mtl_file) {
-				tri_mat = converted_mats[shapes[s].mesh.material_ids[f]];
-			}
-			else {
-				tri_mat = model_material;
-			}
+			if (keep && !keep(tri_v[0], tri_v[1], tri_v[2]))
+				continue;
 
+			shared_ptr<material> tri_mat = face.material >= 0 && size_t(face.material) < converted_mats.size()
+				? converted_mats[face.material]
+				: model_material;
 
 			if (has_normals) {
 				shape_triangles.add(make_shared<triangle>(
@@ -184,23 +225,27 @@ shared_ptr<hittable> load_model_from_file(std::string filename, shared_ptr<mater
 				shape_triangles.add(make_shared<triangle>(
 					tri_v[0], tri_v[1], tri_v[2], tri_mat));
 			}
-
-		
-			//std::clog << "Assigning triangle (" << tri_v[0] << ", " << tri_v[1] << ", " << tri_v[2] << ")\n";
-			//std::clog << "Normals (" << tri_vn[0] << ", " << tri_vn[1] << ", " << tri_vn[2] << ")\n";
-			//std::clog << "Made it to line 119\n";
-			index_offset += fv;
 		}
+		if (shape_triangles.objects.empty())
+			continue;
+
+		trace_scope bvh_span("shape_bvh", "build", shape.name);
 		model_output.add(make_shared<bvh_node>(shape_triangles, 0, shape_triangles.objects.size()));
-		
-		
-		/*std::clog << "Model output\n";
-		model_output.bounding_box().print(std::clog);*/
 	}
-	/*std::clog << "\n\n\nBefore returning\n";
-	model_output.bounding_box().print(std::clog);*/
-	
 
+	if (model_output.objects.empty())
+		return make_shared<hittable_list>();
+	trace_scope bvh_span("model_bvh", "build", name);
 	return make_shared<bvh_node>(model_output, 0, model_output.objects.size());
 }
-#endif // OBJ_LOADER_H
\ No newline at end of file
+
+shared_ptr<hittable> build_model(const mesh& model, shared_ptr<material> model_material, double wavelength, const std::string& name = "model",
+	const face_filter& keep = nullptr) {
+	return build_model(model, convert_materials(model, wavelength), model_material, name, keep);
+}
+
+shared_ptr<hittable> load_model_from_file(std::string filename, shared_ptr<material> model_material, double wavelength) {
+	trace_scope load_span("load_model", "load", filename);
+	return build_model(load_mesh(filename), model_material, wavelength, filename);
+}
+#endif // OBJ_LOADER_H
@@ -0,0 +1,43 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+/*
+* Minimal work distribution: worker threads pull job indices from a shared atomic counter.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/*Returns the number of workers to use for a requested thread count, 0 meaning one per hardware thread*/
+inline int worker_count(int requested) {
+	if (requested > 0)
+		return requested;
+	unsigned int hw = std::thread::hardware_concurrency();
+	return hw == 0 ? 1 : int(hw);
+}
+
+/*
+Calls fn(job, worker) for every job in [0, count) using up to `threads` workers.
+The calling thread is worker 0, so a single-threaded run spawns no threads at all.
+*/
+template <typename F>
+void parallel_for(size_t count, int threads, F&& fn) {
+	int workers = int(std::min<size_t>(size_t(worker_count(threads)), std::max<size_t>(count, 1)));
+	std::atomic<size_t> next(0);
+
+	auto run = [&](int worker) {
+		for (size_t job = next++; job < count; job = next++)
+			fn(job, worker);
+	};
+
+	std::vector<std::thread> pool;
+	for (int w = 1; w < workers; w++)
+		pool.emplace_back(run, w);
+	run(0);
+	for (std::thread& t : pool)
+		t.join();
+}
+
+#endif // PARALLEL_H
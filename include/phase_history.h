@@ -0,0 +1,163 @@
+#ifndef PHASE_HISTORY_H
+#define PHASE_HISTORY_H
+
+/*
+* Raw radar echoes for algorithm testing. Pulses are fired from positions along the flight line; every
+* return adds a complex sample to its pulse's range profile, with amplitude from the path's energy and
+* phase -4*pi*R/wavelength. The profiles are range compressed already, so backprojection focuses them
+* directly (see backproject()).
+*/
+
+#include "coherent.h"
+#include "parallel.h"
+#include "range_doppler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+class phase_history {
+public:
+	phase_history() {}
+	phase_history(int pulses, int range_bins, const interval& range, double wavelength)
+		: pulses(pulses), range_bins(range_bins), range(range), wavelength(wavelength),
+		samples(size_t(pulses) * range_bins) {}
+
+	bool empty() const { return samples.empty(); }
+
+	/*Adds a return with one-way range r to a pulse's profile; returns outside the range span are dropped*/
+	void add(int pulse, double r, double amplitude) {
+		int bin = int((r - range.min) / range.size() * range_bins);
+		if (bin < 0 || bin >= range_bins)
+			return;
+		samples.add(size_t(pulse) * range_bins + bin, amplitude, two_way_phase(r, wavelength));
+	}
+
+	void merge(const phase_history& other) { samples.merge(other.samples); }
+
+	/*
+	Writes <prefix>.cf32, interleaved float32 (re, im) pairs with one row of range bins per pulse in native
+	byte order, and <prefix>.txt, the geometry needed to focus it: wavelength, range bins and span, and
+	every pulse's antenna position.
+	*/
+	void write(const std::string& prefix, const std::vector<point3>& positions) const {
+		std::vector<float> interleaved(2 * samples.size());
+		for (size_t i = 0; i < samples.size(); i++) {
+			interleaved[2 * i] = samples.re[i];
+			interleaved[2 * i + 1] = samples.im[i];
+		}
+		std::ofstream raw(prefix + ".cf32", std::ios::binary);
+		std::ofstream info(prefix + ".txt");
+		if (!raw || !info) {
+			std::cerr << "Cannot write phase history " << prefix << std::endl;
+			exit(-1);
+		}
+		raw.write(reinterpret_cast<const char*>(interleaved.data()), std::streamsize(interleaved.size() * sizeof(float)));
+
+		info.precision(17);
+		info << "wavelength " << wavelength << "\n"
+			<< "pulses " << pulses << "\n"
+			<< "range_bins " << range_bins << "\n"
+			<< "range " << range.min << " " << range.max << "\n";
+		for (int p = 0; p < pulses; p++)
+			info << "pulse " << p << " " << positions[p] << "\n";
+
+		std::clog << "Phase history written to " << prefix << ".cf32 and " << prefix << ".txt ("
+			<< pulses << " pulses x " << range_bins << " range bins)\n";
+	}
+
+	/*
+	Focuses the echoes onto `image` by backprojection: each image bin is a point on the ground (see
+	point_at), and sums every pulse's interpolated range sample at that point's range, with the phase
+	rotated back by 4*pi*R/wavelength. Rows run in parallel, and the inner loop walks a row's bins for one
+	pulse at a time without branches so it vectorizes at -O3 with -fno-math-errno (see CMakeLists.txt):
+	bins outside the profile get a zero weight, and the phase is reduced to turns in double before
+	unit_phasor evaluates it in float.
+	*/
+	template <typename F>
+	void backproject(range_doppler_grid& image, const std::vector<point3>& positions, F&& point_at, int threads) const {
+		int columns = image.range_bin_count();
+		int rows = image.azimuth_bin_count();
+		double bins_per_meter = range_bins / range.size();
+		double turns_per_meter = 2.0 / wavelength;
+		double first_range = range.min;
+		double last_bin = range_bins - 1;
+		int last_pair = range_bins - 2;		// First bin of the last pair to interpolate between
+
+		parallel_for(size_t(rows), threads, [&](size_t row, int) {
+			std::vector<double> x(columns), y(columns), z(columns);
+			std::vector<double> sum_re(columns, 0.0), sum_im(columns, 0.0);	// Double, which the float profiles cannot alias
+			for (int k = 0; k < columns; k++) {
+				point3 p = point_at(k, int(row));
+				x[k] = p.x();
+				y[k] = p.y();
+				z[k] = p.z();
+			}
+			if (range_bins < 2)
+				return;
+
+			// Plain pointers, so the stores to the sums cannot be taken for writes to the vectors themselves
+			const double* px = x.data(), * py = y.data(), * pz = z.data();
+			double* out_re = sum_re.data(), * out_im = sum_im.data();
+			for (int pulse = 0; pulse < pulses; pulse++) {
+				const float* profile_re = &samples.re[size_t(pulse) * range_bins];
+				const float* profile_im = &samples.im[size_t(pulse) * range_bins];
+				const float* next_re = profile_re + 1, * next_im = profile_im + 1;
+				double ax = positions[pulse].x(), ay = positions[pulse].y(), az = positions[pulse].z();
+				for (int k = 0; k < columns; k++) {
+					double dx = px[k] - ax, dy = py[k] - ay, dz = pz[k] - az;
+					double r = std::sqrt(dx * dx + dy * dy + dz * dz);
+					double s = (r - first_range) * bins_per_meter - 0.5;
+					float weight = float(s >= 0.0) * float(s < last_bin);
+					double clamped = std::min(std::max(s, 0.0), last_bin);
+					int b = std::min(int(clamped), last_pair);
+					float f = float(clamped - b);
+					float sample_re = weight * ((1.0f - f) * profile_re[b] + f * next_re[b]);
+					float sample_im = weight * ((1.0f - f) * profile_im[b] + f * next_im[b]);
+
+					float c, sn;
+					unit_phasor(nearest_turn(r * turns_per_meter), c, sn);
+					out_re[k] += sample_re * c - sample_im * sn;
+					out_im[k] += sample_re * sn + sample_im * c;
+				}
+			}
+
+			for (int k = 0; k < columns; k++)
+				image.set(k, int(row), sum_re[k] * sum_re[k] + sum_im[k] * sum_im[k]);
+		});
+	}
+
+	/*t minus the nearest whole number, in -0.5..0.5; adding and removing 1.5 * 2^52 rounds without a branch*/
+	static float nearest_turn(double t) {
+		const double round = 6755399441055744.0;
+		return float(t - ((t + round) - round));
+	}
+
+	/*cos and sin of 2*pi*turns for turns in -0.5..0.5: a quadrant, then polynomials over -pi/4..pi/4*/
+	static void unit_phasor(float turns, float& c, float& s) {
+		float x = 4.0f * turns;
+		int quadrant = int(x + 2.5f) - 2;
+		float a = (x - float(quadrant)) * float(pi / 2);
+		float a2 = a * a;
+		float sin_a = a * (1.0f + a2 * (-1.0f / 6 + a2 * (1.0f / 120 + a2 * (-1.0f / 5040))));
+		float cos_a = 1.0f + a2 * (-0.5f + a2 * (1.0f / 24 + a2 * (-1.0f / 720 + a2 * (1.0f / 40320))));
+		// Quadrants 1 and 3 swap cos and sin; 1 and 2 negate cos, 2 and 3 sin
+		float swap = float(quadrant & 1);
+		float sign_c = float(1 - 2 * (((quadrant + 1) >> 1) & 1));
+		float sign_s = float(1 - 2 * ((quadrant >> 1) & 1));
+		c = sign_c * (cos_a + swap * (sin_a - cos_a));
+		s = sign_s * (sin_a + swap * (cos_a - sin_a));
+	}
+
+private:
+	int pulses = 0;
+	int range_bins = 0;
+	interval range;
+	double wavelength = 1.0;
+	complex_buffer samples;		// One row of range bins per pulse
+};
+
+#endif // PHASE_HISTORY_H
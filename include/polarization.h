@@ -0,0 +1,51 @@
+#ifndef POLARIZATION_H
+#define POLARIZATION_H
+
+/*
+* Polarization along a path, for quad-pol (HH, HV, VH, VV) images. A path carries the unit electric field
+* vector of the wave transmitted H and of the wave transmitted V. Specular bounces reflect the field as a
+* perfect conductor does (its tangential part flips), so odd bounces return HH = VV and dihedrals
+* HH = -VV; diffuse bounces and volumes leave it randomly oriented, which is where cross-pol comes from.
+* Channels are named transmit then receive, and antennas use the backscatter alignment convention.
+*/
+
+const int POL_COUNT = 4;
+
+inline const char* pol_name(int channel) {
+	static const char* names[POL_COUNT] = { "HH", "HV", "VH", "VV" };
+	return names[channel];
+}
+
+/*Horizontal polarization for a wave traveling along d: perpendicular to d and to `up` (or to `fallback` when d is vertical)*/
+inline vec3 horizontal_field(const vec3& d, const vec3& up, const vec3& fallback) {
+	vec3 h = cross(up, d);
+	return h.length_squared() > 1e-12 * d.length_squared() ? unit_vector(h) : fallback;
+}
+
+/*Vertical polarization for a wave traveling along d, completing horizontal_field*/
+inline vec3 vertical_field(const vec3& d, const vec3& up, const vec3& fallback) {
+	return unit_vector(cross(unit_vector(d), horizontal_field(d, up, fallback)));
+}
+
+/*A randomly oriented field for a wave leaving along `out`, as after a diffuse bounce*/
+inline vec3 depolarized_field(const vec3& out) {
+	vec3 d = unit_vector(out);
+	vec3 e = random_unit_vector();
+	e = e - dot(e, d) * d;
+	return e.length_squared() > 1e-12 ? unit_vector(e) : horizontal_field(d, vec3(0, 1, 0), vec3(1, 0, 0));
+}
+
+/*
+The field after a specular event at a surface with normal n: mirror reflection flips its tangential
+part, transmission keeps it. Either way it is projected onto the plane perpendicular to `out`, which
+absorbs the tilt of fuzzy reflections.
+*/
+inline vec3 specular_field(const vec3& field, const vec3& in, const vec3& n, const vec3& out) {
+	bool reflected = dot(in, n) * dot(out, n) < 0;
+	vec3 e = reflected ? 2 * dot(field, n) * n - field : field;
+	vec3 d = unit_vector(out);
+	e = e - dot(e, d) * d;
+	return e.length_squared() > 1e-12 ? unit_vector(e) : depolarized_field(out);
+}
+
+#endif // POLARIZATION_H
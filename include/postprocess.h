@@ -0,0 +1,321 @@
+#ifndef POSTPROCESS_H
+#define POSTPROCESS_H
+
+/*
+* SAR post-processing on a render's float intensity buffer, before it is written: multi-look averaging,
+* Lee and Frost speckle filters, dB scaling and a percentile stretch. A pipeline is a comma separated
+* list of stages, run in order:
+*
+*   multilook:AxR        Average A azimuth (row) by R range (column) looks, shrinking the image
+*   lee:W[:looks]        Lee filter over a WxW window; looks defaults to those taken by multilook
+*   frost:W[:damping]    Frost filter over a WxW window, damping defaults to 2
+*   db                   10*log10 of the intensity; empty pixels take the faintest return's value. Written
+*                        last, the .ppm spans the image's dB range
+*   stretch[:low:high]   Maps the low..high percentiles (default 2..98) onto 0..1
+*
+* Every stage works row by row across the render threads over flat float arrays, with local statistics
+* from summed-area tables so window size barely changes the cost of the Lee filter.
+*/
+
+#include "common.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*How write_intensity maps a pipeline's output to display levels*/
+enum INTENSITY_SCALE {
+	POWER_SCALE,		// Linear power: written as amplitude against the 99th percentile
+	STRETCH_SCALE,		// Already in 0..1 from a stretch: written as is
+	DB_SCALE			// Decibels: the minimum..maximum range mapped onto 0..1
+};
+
+struct intensity_image {
+	int width = 0;
+	int height = 0;
+	std::vector<float> data;	// Row-major
+
+	intensity_image() {}
+	intensity_image(int width, int height) : width(width), height(height), data(size_t(width) * height, 0.0f) {}
+
+	float& at(int x, int y) { return data[size_t(y) * width + x]; }
+	float at(int x, int y) const { return data[size_t(y) * width + x]; }
+};
+
+class postprocess_pipeline {
+public:
+	/*Parses a stage list such as "multilook:2x2,lee:5,db,stretch". Describes the problem in `error` on failure.*/
+	static bool parse(const std::string& spec, postprocess_pipeline& pipeline, std::string& error) {
+		pipeline.stages.clear();
+		std::istringstream list(spec);
+		std::string item;
+		while (std::getline(list, item, ',')) {
+			std::vector<std::string> parts;
+			std::istringstream fields(item);
+			for (std::string part; std::getline(fields, part, ':');)
+				parts.push_back(part);
+			if (parts.empty())
+				continue;
+
+			stage s;
+			s.name = parts[0];
+			bool ok = true;
+			if (s.name == "multilook") {
+				size_t x = parts.size() == 2 ? parts[1].find('x') : std::string::npos;
+				ok = x != std::string::npos && parse_count(parts[1].substr(0, x), s.a) && parse_count(parts[1].substr(x + 1), s.b);
+			}
+			else if (s.name == "lee") {
+				s.b = 0;
+				ok = (parts.size() == 2 || parts.size() == 3) && parse_count(parts[1], s.a) && (parts.size() == 2 || parse_count(parts[2], s.b));
+			}
+			else if (s.name == "frost") {
+				s.x = 2.0;
+				ok = (parts.size() == 2 || parts.size() == 3) && parse_count(parts[1], s.a) && (parts.size() == 2 || parse_double(parts[2], s.x));
+			}
+			else if (s.name == "db") {
+				ok = parts.size() == 1;
+			}
+			else if (s.name == "stretch") {
+				s.x = 2.0;
+				s.y = 98.0;
+				ok = (parts.size() == 1 || parts.size() == 3) && (parts.size() == 1 || (parse_double(parts[1], s.x) && parse_double(parts[2], s.y) && s.x < s.y));
+			}
+			else {
+				ok = false;
+			}
+			if (!ok) {
+				error = "bad post-processing stage '" + item + "'";
+				return false;
+			}
+			pipeline.stages.push_back(s);
+		}
+		return true;
+	}
+
+	bool empty() const { return stages.empty(); }
+
+	/*The scale of run's output, set by the last stage: stretch leaves display values in 0..1, db decibels*/
+	INTENSITY_SCALE output_scale() const {
+		if (stages.empty())
+			return POWER_SCALE;
+		return stages.back().name == "stretch" ? STRETCH_SCALE : stages.back().name == "db" ? DB_SCALE : POWER_SCALE;
+	}
+
+	intensity_image run(intensity_image image, int threads) const {
+		int looks = 1;
+		for (const stage& s : stages) {
+			if (s.name == "multilook") {
+				image = multilook(image, s.a, s.b, threads);
+				looks *= s.a * s.b;
+			}
+			else if (s.name == "lee") {
+				image = lee(image, s.a, s.b > 0 ? s.b : looks, threads);
+			}
+			else if (s.name == "frost") {
+				image = frost(image, s.a, s.x, threads);
+			}
+			else if (s.name == "db") {
+				to_db(image);
+			}
+			else if (s.name == "stretch") {
+				stretch(image, s.x, s.y);
+			}
+		}
+		return image;
+	}
+
+private:
+	struct stage {
+		std::string name;
+		int a = 0, b = 0;			// Integer arguments: window or looks
+		double x = 0.0, y = 0.0;	// Real arguments: damping or percentiles
+	};
+	std::vector<stage> stages;
+
+	static bool parse_count(const std::string& s, int& n) {
+		char* end = nullptr;
+		long v = std::strtol(s.c_str(), &end, 10);
+		n = int(v);
+		return !s.empty() && end == s.c_str() + s.size() && v > 0;
+	}
+
+	static intensity_image multilook(const intensity_image& in, int rows, int columns, int threads) {
+		intensity_image out(std::max(1, in.width / columns), std::max(1, in.height / rows));
+		float scale = 1.0f / float(rows * columns);
+		parallel_for(size_t(out.height), threads, [&](size_t y, int) {
+			float* dst = &out.data[y * out.width];
+			for (int r = 0; r < rows && int(y) * rows + r < in.height; r++) {
+				const float* src = &in.data[(y * rows + r) * in.width];
+				for (int x = 0; x < out.width; x++)
+					for (int c = 0; c < columns && x * columns + c < in.width; c++)
+						dst[x] += src[x * columns + c];
+			}
+			for (int x = 0; x < out.width; x++)
+				dst[x] *= scale;
+		});
+		return out;
+	}
+
+	/*Summed-area tables of intensity and squared intensity, with a zero first row and column*/
+	struct window_sums {
+		int width;
+		std::vector<double> sum, sum_sq;
+
+		window_sums(const intensity_image& image) : width(image.width + 1),
+			sum(size_t(image.width + 1) * (image.height + 1), 0.0), sum_sq(sum.size(), 0.0) {
+			for (int y = 0; y < image.height; y++) {
+				double row = 0.0, row_sq = 0.0;
+				for (int x = 0; x < image.width; x++) {
+					double v = image.at(x, y);
+					row += v;
+					row_sq += v * v;
+					sum[size_t(y + 1) * width + x + 1] = sum[size_t(y) * width + x + 1] + row;
+					sum_sq[size_t(y + 1) * width + x + 1] = sum_sq[size_t(y) * width + x + 1] + row_sq;
+				}
+			}
+		}
+
+		/*Mean and variance over [x0, x1) x [y0, y1)*/
+		void stats(int x0, int y0, int x1, int y1, double& mean, double& variance) const {
+			auto box = [&](const std::vector<double>& t) {
+				return t[size_t(y1) * width + x1] - t[size_t(y0) * width + x1] - t[size_t(y1) * width + x0] + t[size_t(y0) * width + x0];
+			};
+			double n = double(x1 - x0) * (y1 - y0);
+			mean = box(sum) / n;
+			variance = std::max(0.0, box(sum_sq) / n - mean * mean);
+		}
+	};
+
+	/*Lee filter: blends each pixel toward its local mean by how much of the local variance is speckle*/
+	static intensity_image lee(const intensity_image& in, int window, int looks, int threads) {
+		window_sums sums(in);
+		intensity_image out(in.width, in.height);
+		double cu2 = 1.0 / looks;	// Squared speckle coefficient of variation
+		int half = window / 2;
+		parallel_for(size_t(in.height), threads, [&](size_t y, int) {
+			int y0 = std::max(0, int(y) - half), y1 = std::min(in.height, int(y) + half + 1);
+			for (int x = 0; x < in.width; x++) {
+				double mean, variance;
+				sums.stats(std::max(0, x - half), y0, std::min(in.width, x + half + 1), y1, mean, variance);
+				double signal = std::max(0.0, (variance - mean * mean * cu2) / (1.0 + cu2));
+				double k = variance > 0.0 ? signal / variance : 0.0;
+				out.at(x, int(y)) = float(mean + k * (in.at(x, int(y)) - mean));
+			}
+		});
+		return out;
+	}
+
+	/*Frost filter: an exponential kernel that narrows where the local coefficient of variation is high*/
+	static intensity_image frost(const intensity_image& in, int window, double damping, int threads) {
+		window_sums sums(in);
+		intensity_image out(in.width, in.height);
+		int half = window / 2;
+		std::vector<float> distance;
+		for (int dy = -half; dy <= half; dy++)
+			for (int dx = -half; dx <= half; dx++)
+				distance.push_back(float(std::sqrt(double(dx * dx + dy * dy))));
+
+		parallel_for(size_t(in.height), threads, [&](size_t y, int) {
+			std::vector<float> weight(distance.size());
+			for (int x = 0; x < in.width; x++) {
+				double mean, variance;
+				sums.stats(std::max(0, x - half), std::max(0, int(y) - half), std::min(in.width, x + half + 1), std::min(in.height, int(y) + half + 1), mean, variance);
+				float a = float(mean > 0.0 ? damping * variance / (mean * mean) : 0.0);
+				for (size_t k = 0; k < distance.size(); k++)
+					weight[k] = std::exp(-a * distance[k]);
+
+				double total = 0.0, weights = 0.0;
+				size_t k = 0;
+				for (int dy = -half; dy <= half; dy++) {
+					for (int dx = -half; dx <= half; dx++, k++) {
+						int sx = x + dx, sy = int(y) + dy;
+						if (sx < 0 || sx >= in.width || sy < 0 || sy >= in.height)
+							continue;
+						total += weight[k] * in.at(sx, sy);
+						weights += weight[k];
+					}
+				}
+				out.at(x, int(y)) = float(total / weights);
+			}
+		});
+		return out;
+	}
+
+	static void to_db(intensity_image& image) {
+		float faintest = 0.0f;
+		for (float v : image.data)
+			if (v > 0.0f && (faintest == 0.0f || v < faintest))
+				faintest = v;
+		if (faintest == 0.0f)
+			faintest = 1.0f;
+		for (float& v : image.data)
+			v = 10.0f * std::log10(std::max(v, faintest));
+	}
+
+	static void stretch(intensity_image& image, double low, double high) {
+		std::vector<float> sorted = image.data;
+		auto percentile = [&](double p) {
+			auto at = sorted.begin() + size_t(std::clamp(p / 100.0, 0.0, 1.0) * (sorted.size() - 1));
+			std::nth_element(sorted.begin(), at, sorted.end());
+			return *at;
+		};
+		float lo = percentile(low), hi = percentile(high);
+		float scale = hi > lo ? 1.0f / (hi - lo) : 0.0f;
+		for (float& v : image.data)
+			v = std::clamp((v - lo) * scale, 0.0f, 1.0f);
+	}
+};
+
+/*
+Writes <prefix>.f32, the image as row-major float32 in native byte order, and <prefix>.ppm. Stretched
+images are written as is, dB images from their minimum to their maximum, and others as amplitude,
+normalized to their 99th percentile nonzero value.
+*/
+inline void write_intensity(const std::string& prefix, const intensity_image& image, INTENSITY_SCALE scale) {
+	std::ofstream raw(prefix + ".f32", std::ios::binary);
+	raw.write(reinterpret_cast<const char*>(image.data.data()), std::streamsize(image.data.size() * sizeof(float)));
+
+	float lowest = 0.0f, range = 1.0f;
+	if (scale == DB_SCALE && !image.data.empty()) {
+		auto [lo, hi] = std::minmax_element(image.data.begin(), image.data.end());
+		lowest = *lo;
+		range = *hi > *lo ? *hi - *lo : 1.0f;
+	}
+
+	double reference = 1.0;
+	if (scale == POWER_SCALE) {
+		std::vector<float> lit;
+		for (float v : image.data)
+			if (v > 0.0f)
+				lit.push_back(v);
+		if (!lit.empty()) {
+			auto p99 = lit.begin() + size_t(0.99 * (lit.size() - 1));
+			std::nth_element(lit.begin(), p99, lit.end());
+			reference = *p99;
+		}
+	}
+
+	std::ofstream img(prefix + ".ppm");
+	if (!img) {
+		std::cerr << "Cannot write image " << prefix << ".ppm" << std::endl;
+		exit(-1);
+	}
+	img << "P3\n" << image.width << ' ' << image.height << "\n255\n";
+	for (float v : image.data) {
+		if (scale != POWER_SCALE) {
+			int level = int(255.999 * (scale == DB_SCALE ? (v - lowest) / range : v));
+			img << level << ' ' << level << ' ' << level << '\n';
+		}
+		else {
+			double t = v / reference;
+			write_color(img, color(t, t, t));	// Gamma 2 turns energy into amplitude
+		}
+	}
+}
+
+#endif // POSTPROCESS_H
@@ -0,0 +1,136 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+/*
+* Background progress reporting for multithreaded renders.
+*
+* Workers publish their counters with relaxed atomic stores; a reporter thread wakes every `interval`
+* seconds and prints completed tiles and samples, current and average Mrays/s, ETA and how busy each
+* worker has been. In machine-readable mode every report is a single key=value line, e.g.
+*
+*   progress tiles=12/140 samples=98304/1146880 mrays=3.210 avg_mrays=3.050 elapsed_s=14.2 eta_s=151.6 busy=0.99,0.98
+*/
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class progress_reporter {
+public:
+	progress_reporter(size_t total_tiles, uint64_t total_samples, int workers, bool machine_readable, double interval)
+		: total_tiles(total_tiles), total_samples(total_samples), machine_readable(machine_readable), interval(interval),
+		slots(new worker_slot[workers]), worker_total(workers) {}
+
+	~progress_reporter() { stop(); }
+
+	void start() {
+		start_time = std::chrono::steady_clock::now();
+		last_time = start_time;
+		reporter = std::thread([this] { run(); });
+	}
+
+	/*Stops the reporter thread and prints a final report*/
+	void stop() {
+		if (!reporter.joinable())
+			return;
+		{
+			std::lock_guard<std::mutex> lock(wake_mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		reporter.join();
+		report(true);
+	}
+
+	/*Called by worker threads as work completes; counts are cumulative for that worker*/
+	void update(int worker, uint64_t samples, uint64_t rays, double busy_seconds) {
+		worker_slot& slot = slots[worker];
+		slot.samples.store(samples, std::memory_order_relaxed);
+		slot.rays.store(rays, std::memory_order_relaxed);
+		slot.busy_ns.store(uint64_t(busy_seconds * 1e9), std::memory_order_relaxed);
+	}
+
+	void tile_done() { tiles_done.fetch_add(1, std::memory_order_relaxed); }
+
+private:
+	struct alignas(64) worker_slot {	// One cache line per worker so updates don't false-share
+		std::atomic<uint64_t> samples{ 0 };
+		std::atomic<uint64_t> rays{ 0 };
+		std::atomic<uint64_t> busy_ns{ 0 };
+	};
+
+	size_t total_tiles;
+	uint64_t total_samples;
+	bool machine_readable;
+	double interval;
+	std::unique_ptr<worker_slot[]> slots;
+	int worker_total;
+	std::atomic<size_t> tiles_done{ 0 };
+
+	std::thread reporter;
+	std::mutex wake_mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+
+	std::chrono::steady_clock::time_point start_time, last_time;
+	uint64_t last_rays = 0;
+
+	void run() {
+		std::unique_lock<std::mutex> lock(wake_mutex);
+		while (!wake.wait_for(lock, std::chrono::duration<double>(interval), [this] { return stopping; }))
+			report(false);
+	}
+
+	void report(bool final) {
+		auto now = std::chrono::steady_clock::now();
+		double elapsed = std::chrono::duration<double>(now - start_time).count();
+		double dt = std::chrono::duration<double>(now - last_time).count();
+
+		uint64_t samples = 0, rays = 0;
+		std::vector<double> busy(worker_total);
+		for (int w = 0; w < worker_total; w++) {
+			samples += slots[w].samples.load(std::memory_order_relaxed);
+			rays += slots[w].rays.load(std::memory_order_relaxed);
+			busy[w] = elapsed > 0.0 ? slots[w].busy_ns.load(std::memory_order_relaxed) * 1e-9 / elapsed : 0.0;
+		}
+
+		double current_mrays = dt > 0.0 ? (rays - last_rays) / dt * 1e-6 : 0.0;
+		double average_mrays = elapsed > 0.0 ? rays / elapsed * 1e-6 : 0.0;
+		double eta = samples > 0 ? elapsed * double(total_samples - samples) / samples : -1.0;
+		last_time = now;
+		last_rays = rays;
+
+		char line[256];
+		std::string busy_list;
+		if (machine_readable) {
+			for (int w = 0; w < worker_total; w++) {
+				std::snprintf(line, sizeof(line), "%s%.2f", w ? "," : "", busy[w]);
+				busy_list += line;
+			}
+			std::snprintf(line, sizeof(line), "progress tiles=%zu/%zu samples=%llu/%llu mrays=%.3f avg_mrays=%.3f elapsed_s=%.1f eta_s=%.1f busy=",
+				tiles_done.load(std::memory_order_relaxed), total_tiles, (unsigned long long)samples, (unsigned long long)total_samples,
+				current_mrays, average_mrays, elapsed, final ? 0.0 : eta);
+			std::clog << line << busy_list << (final ? " done" : "") << std::endl;
+			return;
+		}
+
+		for (int w = 0; w < worker_total; w++) {
+			std::snprintf(line, sizeof(line), " %3.0f%%", 100.0 * busy[w]);
+			busy_list += line;
+		}
+		int eta_s = eta < 0.0 ? 0 : int(eta);
+		std::snprintf(line, sizeof(line), "\rTiles %zu/%zu (%.1f%%) | %.2f Mrays/s (avg %.2f) | ETA %02d:%02d:%02d | busy",
+			tiles_done.load(std::memory_order_relaxed), total_tiles, total_samples ? 100.0 * samples / total_samples : 100.0,
+			current_mrays, average_mrays, eta_s / 3600, (eta_s / 60) % 60, eta_s % 60);
+		std::clog << line << busy_list << (final ? "\n" : " ") << std::flush;
+	}
+};
+
+#endif // PROGRESS_H
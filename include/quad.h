@@ -3,8 +3,7 @@
 
 #include "hittable.h"
 #include "hittable_list.h"
-
-extern int quad_hits;
+#include "render_stats.h"
 
 class quad : public hittable {
 public: 
@@ -29,6 +28,7 @@ public:
 	aabb bounding_box() const override { return bbox; }
 
 	bool hit(const ray& r, interval ray_t, hit_record& rec) const override { 
+		thread_stats.prim_tests++;
 		double denom = dot(normal, r.direction());
 
 		// If ray is parallel to plane, it misses
@@ -48,7 +48,7 @@ public:
 		if (!is_interior(alpha, beta, rec))
 			return false;
 
-		quad_hits++;
+		thread_stats.quad_hits++;
 		rec.t = t;
 		rec.p = intersection;
 		rec.mat = mat;
@@ -84,6 +84,14 @@ public:
 		return p - origin;
 	}
 
+	/*Two triangles, their texture coordinates the alpha, beta that hit records*/
+	bool triangulate(const placement& place, std::vector<world_triangle>& out) const override {
+		point3 a = place(Q), b = place(Q + u), c = place(Q + u + v), d = place(Q + v);
+		out.push_back({ { a, b, d }, { vec3(0, 0, 0), vec3(1, 0, 0), vec3(0, 1, 0) }, mat });
+		out.push_back({ { b, c, d }, { vec3(1, 0, 0), vec3(1, 1, 0), vec3(0, 1, 0) }, mat });
+		return true;
+	}
+
 private:
 	point3 Q;
 	vec3 u, v;
@@ -0,0 +1,154 @@
+#ifndef RANGE_DOPPLER_H
+#define RANGE_DOPPLER_H
+
+/*
+* Range-Doppler image formation. Instead of a perspective photograph, each path that returns to the
+* colocated radar is placed by its slant range (half the total path length, measured from the flight
+* line) and its azimuth (position along the flight line), so tall objects lay over toward the sensor and
+* slopes foreshorten the way they do in real SAR images.
+*
+* Multi-bounce returns follow the usual convention: the range is half the full path length, and the
+* azimuth is the mean of the first and last scatterers' positions along track.
+*/
+
+#include "coherent.h"
+#include "postprocess.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*Straight, level flight line through the sensor position, used to measure range and azimuth*/
+struct sar_track {
+	point3 origin;			// Sensor position at azimuth 0
+	vec3 direction;			// Unit flight direction
+
+	double azimuth(const point3& p) const { return dot(p - origin, direction); }
+
+	/*Distance from p to the flight line, the one-way range at closest approach*/
+	double range(const point3& p) const {
+		vec3 d = p - origin;
+		return (d - dot(d, direction) * direction).length();
+	}
+};
+
+/*
+Energy binned by slant range (columns, near range left) and azimuth (rows, flight direction up). Each
+render worker fills its own grid, so binning needs no locks or atomics; grids are merged afterwards.
+A coherent grid sums complex amplitudes instead, and detect() turns them into energy once merged.
+*/
+class range_doppler_grid {
+public:
+	range_doppler_grid() {}
+	range_doppler_grid(int range_bins, int azimuth_bins, const interval& range, const interval& azimuth, bool coherent = false)
+		: range_bins(range_bins), azimuth_bins(azimuth_bins), range(range), azimuth(azimuth),
+		energy(size_t(range_bins) * azimuth_bins, 0.0) {
+		if (coherent)
+			field = complex_buffer(energy.size());
+	}
+
+	bool empty() const { return energy.empty(); }
+
+	/*Adds a return; returns outside the grid are dropped*/
+	void add(double slant_range, double along_track, double e) {
+		int r = int((slant_range - range.min) / range.size() * range_bins);
+		int a = int((azimuth.max - along_track) / azimuth.size() * azimuth_bins);
+		if (r < 0 || r >= range_bins || a < 0 || a >= azimuth_bins)
+			return;
+		energy[size_t(a) * range_bins + r] += e;
+	}
+
+	/*Adds a return's complex amplitude to a coherent grid*/
+	void add(double slant_range, double along_track, double amplitude, double phase) {
+		int r = int((slant_range - range.min) / range.size() * range_bins);
+		int a = int((azimuth.max - along_track) / azimuth.size() * azimuth_bins);
+		if (r < 0 || r >= range_bins || a < 0 || a >= azimuth_bins)
+			return;
+		field.add(size_t(a) * range_bins + r, amplitude, phase);
+	}
+
+	void merge(const range_doppler_grid& other) {
+		for (size_t i = 0; i < energy.size(); i++)
+			energy[i] += other.energy[i];
+		if (!field.empty())
+			field.merge(other.field);
+	}
+
+	/*Adds the power of the summed amplitudes of a coherent grid to its energy*/
+	void detect() {
+		for (size_t i = 0; i < field.size(); i++)
+			energy[i] += field.power(i);
+		field = complex_buffer();
+	}
+
+	/*
+	Projects the range axis onto flat ground `height` below the flight line: column k covers the same share
+	of the ground range span as it would of the slant range span, and takes the linearly interpolated
+	slant range bin that lands there. Slant ranges shorter than the height never reach the ground.
+	*/
+	range_doppler_grid ground_projected(double height) const {
+		auto ground = [height](double r) { return r > height ? std::sqrt(r * r - height * height) : 0.0; };
+		interval ground_span(ground(range.min), ground(range.max));
+		range_doppler_grid projected(range_bins, azimuth_bins, ground_span, azimuth);
+
+		double slant_bin = range.size() / range_bins;
+		double ground_bin = ground_span.size() / range_bins;
+		for (int k = 0; k < range_bins; k++) {
+			double g = ground_span.min + (k + 0.5) * ground_bin;
+			double x = (std::sqrt(g * g + height * height) - range.min) / slant_bin - 0.5;
+			int r0 = int(std::floor(x));
+			double f = x - r0;
+			// Energy is conserved per unit range: scale by the ground bin's share of slant range
+			double jacobian = (g / std::sqrt(g * g + height * height)) * ground_bin / slant_bin;
+			for (int a = 0; a < azimuth_bins; a++) {
+				double e0 = (r0 >= 0 && r0 < range_bins) ? at(r0, a) : 0.0;
+				double e1 = (r0 + 1 >= 0 && r0 + 1 < range_bins) ? at(r0 + 1, a) : 0.0;
+				projected.energy[size_t(a) * range_bins + k] = ((1.0 - f) * e0 + f * e1) * jacobian;
+			}
+		}
+		return projected;
+	}
+
+	double at(int r, int a) const { return energy[size_t(a) * range_bins + r]; }
+	void set(int r, int a, double e) { energy[size_t(a) * range_bins + r] = e; }
+
+	int range_bin_count() const { return range_bins; }
+	int azimuth_bin_count() const { return azimuth_bins; }
+
+	/*Range and azimuth at the center of a bin*/
+	double range_at(int r) const { return range.min + (r + 0.5) * range.size() / range_bins; }
+	double azimuth_at(int a) const { return azimuth.max - (a + 0.5) * azimuth.size() / azimuth_bins; }
+
+	/*
+	Writes <prefix>.ppm and <prefix>.f32 (see write_intensity) after running the post-processing pipeline,
+	if any, on the energy. Rows are azimuth and columns range.
+	*/
+	void write(const std::string& prefix, const postprocess_pipeline& pipeline = postprocess_pipeline(), int threads = 1) const {
+		intensity_image image(range_bins, azimuth_bins);
+		size_t lit = 0;
+		for (size_t i = 0; i < energy.size(); i++) {
+			image.data[i] = float(energy[i]);
+			lit += energy[i] > 0.0;
+		}
+		if (!pipeline.empty())
+			image = pipeline.run(image, threads);
+		write_intensity(prefix, image, pipeline.output_scale());
+
+		std::clog << "Range-Doppler image written to " << prefix << ".ppm and " << prefix << ".f32 ("
+			<< image.width << "x" << image.height << ", range " << range.min << " to " << range.max
+			<< ", azimuth " << azimuth.min << " to " << azimuth.max << ", " << lit << " bins lit)\n";
+	}
+
+private:
+	int range_bins = 0;
+	int azimuth_bins = 0;
+	interval range;
+	interval azimuth;
+	std::vector<double> energy;
+	complex_buffer field;		// Summed amplitudes of a coherent grid, until detect()
+};
+
+#endif // RANGE_DOPPLER_H
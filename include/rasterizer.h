@@ -0,0 +1,296 @@
+#ifndef RASTERIZER_H
+#define RASTERIZER_H
+
+/*
+* A tiled software rasterizer for primary visibility. Narrow radar views send nearly parallel primary
+* rays, so instead of walking the BVH once per sample, the world's triangles are projected once, binned
+* by image tile, and each tile's samples are resolved against its bin with edge functions and a depth
+* test on the ray parameter. What it finds per sample, the triangle, its barycentric weights and depth,
+* becomes the hit record the path tracer continues from.
+*
+* Everything that does not turn into triangles (spheres, media) is traced per sample against the
+* rasterized depth. Triangles reaching behind a perspective camera are binned by their part in front of
+* it and intersected exactly, so the result is the same first hit the BVH would find.
+*/
+
+#include "hittable.h"
+#include "hittable_list.h"
+#include "parallel.h"
+#include "render_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/*A primary sample: its ray and weight from the camera, and the triangle the rasterizer found for it*/
+struct raster_sample {
+	ray r;
+	double weight = 1.0;
+	int triangle = -1;			// Index of the nearest triangle, -1 for none
+	double t = infinity;
+	double b1 = 0.0, b2 = 0.0;	// Barycentric weights of its second and third vertices
+};
+
+/*
+The image the rasterizer projects onto: pixel (x, y) lies at pixel00 + x * delta_u + y * delta_v, seen
+from `origin` through the plane at `focus` along unit vector `forward`, or straight along `forward` when
+orthographic. delta_u and delta_v are perpendicular to each other and to forward.
+*/
+struct raster_view {
+	bool orthographic = false;
+	point3 origin;
+	vec3 forward;
+	double focus = 1.0;
+	point3 pixel00;
+	vec3 delta_u, delta_v;
+	int width = 0, height = 0;
+	int tile_size = 16;
+};
+
+class rasterizer {
+public:
+	rasterizer() {}
+
+	/*
+	Triangulates `world` and bins its triangles for `view`. Top-level lists are split, so only the
+	objects that cannot be triangulated are left to ray tracing.
+	*/
+	rasterizer(const hittable& world, const raster_view& view, int threads) : view(view) {
+		gather(world);
+
+		screen.resize(triangles.size());
+		normals.resize(triangles.size());
+		const size_t chunk = 4096;
+		parallel_for((triangles.size() + chunk - 1) / chunk, threads, [&](size_t job, int) {
+			for (size_t k = job * chunk; k < std::min(triangles.size(), (job + 1) * chunk); k++) {
+				normals[k] = unit_vector(cross(triangles[k].v[1] - triangles[k].v[0], triangles[k].v[2] - triangles[k].v[0]));
+				place(triangles[k], screen[k]);
+			}
+		});
+
+		int tiles_x = (view.width + view.tile_size - 1) / view.tile_size;
+		int tiles_y = (view.height + view.tile_size - 1) / view.tile_size;
+		bins.resize(size_t(tiles_x) * tiles_y);
+		for (size_t k = 0; k < triangles.size(); k++) {
+			const screen_triangle& s = screen[k];
+			if (!s.visible || !(normals[k].length_squared() > 0))
+				continue;
+			clipped += s.exact;
+
+			// Pixel i's samples fall within [i - 0.5, i + 0.5]
+			if (s.max_x < -0.5 || s.max_y < -0.5 || s.min_x > view.width - 0.5 || s.min_y > view.height - 0.5)
+				continue;
+			int i0 = std::max(0, int(std::ceil(s.min_x - 0.5))), i1 = std::min(view.width - 1, int(std::floor(s.max_x + 0.5)));
+			int j0 = std::max(0, int(std::ceil(s.min_y - 0.5))), j1 = std::min(view.height - 1, int(std::floor(s.max_y + 0.5)));
+			for (int ty = j0 / view.tile_size; ty <= j1 / view.tile_size; ty++)
+				for (int tx = i0 / view.tile_size; tx <= i1 / view.tile_size; tx++)
+					bins[size_t(ty) * tiles_x + tx].push_back(uint32_t(k));
+		}
+	}
+
+	size_t triangle_count() const { return triangles.size(); }
+	size_t clipped_count() const { return clipped; }
+	size_t traced_count() const { return traced.size(); }
+
+	/*
+	Resolves the samples of the pixels x0 <= i < x1, y0 <= j < y1 of the tile with corner x0, y0, stored
+	pixel by pixel along rows with `per_pixel` samples each
+	*/
+	void resolve(int x0, int y0, int x1, int y1, int per_pixel, std::vector<raster_sample>& samples) const {
+		int tiles_x = (view.width + view.tile_size - 1) / view.tile_size;
+		const std::vector<uint32_t>& bin = bins[size_t(y0 / view.tile_size) * tiles_x + x0 / view.tile_size];
+
+		// Where each sample crosses the image
+		std::vector<double> sx(samples.size()), sy(samples.size());
+		for (size_t n = 0; n < samples.size(); n++) {
+			vec3 q;
+			project(samples[n].r.origin() + samples[n].r.direction(), q);
+			sx[n] = q.x();
+			sy[n] = q.y();
+		}
+
+		for (uint32_t k : bin) {
+			const screen_triangle& s = screen[k];
+			double area = edge(s.p[0], s.p[1], s.p[2].x(), s.p[2].y());
+			if (!s.exact && std::fabs(area) < 1e-12)
+				continue;
+			int i0 = std::max(x0, int(std::ceil(s.min_x - 0.5))), i1 = std::min(x1 - 1, int(std::floor(s.max_x + 0.5)));
+			int j0 = std::max(y0, int(std::ceil(s.min_y - 0.5))), j1 = std::min(y1 - 1, int(std::floor(s.max_y + 0.5)));
+
+			for (int j = j0; j <= j1; j++) {
+				for (int i = i0; i <= i1; i++) {
+					size_t first = (size_t(j - y0) * (x1 - x0) + (i - x0)) * per_pixel;
+					for (size_t n = first; n < first + per_pixel; n++) {
+						if (sx[n] < s.min_x || sx[n] > s.max_x || sy[n] < s.min_y || sy[n] > s.max_y)
+							continue;
+						if (s.exact) {
+							double b1, b2;
+							if (intersect(triangles[k], samples[n].r, b1, b2))
+								consider(samples[n], k, 1.0 - b1 - b2, b1, b2);
+							continue;
+						}
+						double l0 = edge(s.p[1], s.p[2], sx[n], sy[n]) / area;
+						double l1 = edge(s.p[2], s.p[0], sx[n], sy[n]) / area;
+						double l2 = 1.0 - l0 - l1;
+						if (l0 < -1e-9 || l1 < -1e-9 || l2 < -1e-9)
+							continue;
+
+						// Perspective correct weights, each screen weight over its vertex's depth
+						double w0 = l0 * s.p[0].z(), w1 = l1 * s.p[1].z(), w2 = l2 * s.p[2].z();
+						double sum = w0 + w1 + w2;
+						w1 /= sum;
+						w2 /= sum;
+						consider(samples[n], k, 1.0 - w1 - w2, w1, w2);
+					}
+				}
+			}
+		}
+	}
+
+	/*The first hit of a resolved sample, with the objects left to ray tracing; false when it escapes*/
+	bool hit(const raster_sample& sample, hit_record& rec) const {
+		bool found = sample.triangle >= 0;
+		if (found) {
+			const world_triangle& tri = triangles[sample.triangle];
+			double b0 = 1.0 - sample.b1 - sample.b2;
+			vec3 uv = b0 * tri.uv[0] + sample.b1 * tri.uv[1] + sample.b2 * tri.uv[2];
+			rec.t = sample.t;
+			rec.p = sample.r.at(sample.t);
+			rec.mat = tri.mat;
+			rec.u = uv.x();
+			rec.v = uv.y();
+			rec.set_face_normal(sample.r, normals[sample.triangle]);
+			rec.front_face = rec.front_face || tri.front_always;
+		}
+
+		double closest = found ? sample.t : infinity;
+		hit_record traced_rec;
+		for (const hittable* object : traced) {
+			thread_stats.rays++;
+			if (object->hit(sample.r, interval(0.001, closest), traced_rec)) {
+				found = true;
+				closest = traced_rec.t;
+				rec = traced_rec;
+			}
+		}
+		return found;
+	}
+
+private:
+	/*
+	A triangle on the image: its vertices' image coordinates x, y and inverse view depth (1 when
+	orthographic), and the bounds of its part in front of the camera. Triangles reaching behind the
+	camera are `exact`: their vertices don't project, so samples intersect them in 3D instead.
+	*/
+	struct screen_triangle {
+		vec3 p[3];
+		double min_x = infinity, max_x = -infinity, min_y = infinity, max_y = -infinity;
+		bool visible = false;
+		bool exact = false;
+	};
+
+	raster_view view;
+	std::vector<world_triangle> triangles;
+	std::vector<vec3> normals;
+	std::vector<screen_triangle> screen;
+	std::vector<std::vector<uint32_t>> bins;	// Triangles overlapping each tile
+	size_t clipped = 0;							// Visible triangles reaching behind the camera
+	std::vector<const hittable*> traced;		// Objects with surfaces other than triangles
+
+	void gather(const hittable& object) {
+		if (auto list = dynamic_cast<const hittable_list*>(&object)) {
+			for (const auto& child : list->objects)
+				gather(*child);
+			return;
+		}
+		size_t before = triangles.size();
+		if (!object.triangulate([](const point3& p) { return p; }, triangles)) {
+			triangles.resize(before);
+			traced.push_back(&object);
+		}
+	}
+
+	/*Projects tri into s, clipping it to the part in front of the camera*/
+	void place(const world_triangle& tri, screen_triangle& s) const {
+		auto extend = [&](const vec3& q) {
+			s.min_x = std::min(s.min_x, q.x());
+			s.max_x = std::max(s.max_x, q.x());
+			s.min_y = std::min(s.min_y, q.y());
+			s.max_y = std::max(s.max_y, q.y());
+			s.visible = true;
+		};
+		bool front[3];
+		for (int c = 0; c < 3; c++) {
+			front[c] = project(tri.v[c], s.p[c]);
+			s.exact = s.exact || !front[c];
+		}
+		for (int c = 0; c < 3; c++) {
+			if (front[c])
+				extend(s.p[c]);
+			if (front[c] == front[(c + 1) % 3])
+				continue;
+
+			// Where the edge crosses just in front of the camera's plane
+			const point3& a = tri.v[c];
+			const point3& b = tri.v[(c + 1) % 3];
+			double da = dot(a - view.origin, view.forward), db = dot(b - view.origin, view.forward);
+			double f = (near_depth() - da) / (db - da);
+			vec3 q;
+			if (project(a + f * (b - a), q))
+				extend(q);
+		}
+	}
+
+	double near_depth() const { return 1e-6 * view.focus; }
+
+	/*Projects world point p to image coordinates and inverse depth; false when it is not in front of the camera*/
+	bool project(const point3& p, vec3& q) const {
+		vec3 d = p - view.origin;
+		double depth = 1.0;
+		if (!view.orthographic) {
+			depth = dot(d, view.forward);
+			if (depth < near_depth())
+				return false;
+			d = d * (view.focus / depth);
+		}
+		vec3 offset = view.origin + d - view.pixel00;
+		q = vec3(dot(offset, view.delta_u) / view.delta_u.length_squared(), dot(offset, view.delta_v) / view.delta_v.length_squared(), 1.0 / depth);
+		return true;
+	}
+
+	static double edge(const vec3& a, const vec3& b, double x, double y) {
+		return (b.x() - a.x()) * (y - a.y()) - (b.y() - a.y()) * (x - a.x());
+	}
+
+	/*
+	Keeps triangle k for the sample if its point at these weights is nearer than what it has. Coincident
+	surfaces go to the later triangle, as they do in a hittable_list.
+	*/
+	void consider(raster_sample& sample, uint32_t k, double b0, double b1, double b2) const {
+		const world_triangle& tri = triangles[k];
+		point3 p = b0 * tri.v[0] + b1 * tri.v[1] + b2 * tri.v[2];
+		const vec3& d = sample.r.direction();
+		double t = dot(p - sample.r.origin(), d) / d.length_squared();
+		if (t < 0.001 || t > sample.t + 1e-9 * t)
+			return;
+		sample.triangle = int(k);
+		sample.t = t;
+		sample.b1 = b1;
+		sample.b2 = b2;
+	}
+
+	/*Moller Trumbore, for the triangles the projection cannot place*/
+	static bool intersect(const world_triangle& tri, const ray& r, double& b1, double& b2) {
+		vec3 edge1 = tri.v[1] - tri.v[0], edge2 = tri.v[2] - tri.v[0];
+		vec3 pvec = cross(r.direction(), edge2);
+		double determinant = dot(edge1, pvec);
+		if (std::fabs(determinant) < 1e-12)
+			return false;
+		vec3 tvec = r.origin() - tri.v[0];
+		b1 = dot(tvec, pvec) / determinant;
+		b2 = dot(r.direction(), cross(tvec, edge1)) / determinant;
+		return b1 >= 0 && b2 >= 0 && b1 + b2 <= 1;
+	}
+};
+
+#endif // RASTERIZER_H
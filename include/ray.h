@@ -5,6 +5,7 @@
 #include <map>
 
 enum SPECTRUM {VISIBLE, X, C, L};
+const int BAND_COUNT = 4;
 
 // Size of the spectrum enum
 //static double SPECTRAL_ARRAY[4] = { 5.5e-7, .03, .06, .23 };
@@ -16,6 +17,11 @@ static std::map<SPECTRUM, double> SPECTRAL_MAP{
 	{L, .23}
 };
 
+inline const char* band_name(SPECTRUM band) {
+	static const char* names[BAND_COUNT] = { "VISIBLE", "X", "C", "L" };
+	return names[band];
+}
+
 class ray
 {
 public:
@@ -0,0 +1,198 @@
+#ifndef RCS_H
+#define RCS_H
+
+/*
+* Radar cross-section sweeps over aspect angles. For each azimuth and elevation of a grid, a plane wave
+* arrives as a square grid of parallel rays covering the world's bounding sphere, each standing for an
+* equal share of the wavefront. Every ray follows mirror reflections like an SBR ray (see
+* camera::trace_mirror_returns) and at each surface it reaches, the analytic facet model
+* (facet_params::scattering) scatters its footprint back toward the radar, past one occlusion check. The
+* sum over rays is the monostatic RCS in square world units, m^2 for models in meters.
+*
+* Facets add up incoherently, so the curves show how strongly each aspect returns but not the
+* interference lobes of a coherent physical optics solution, and flat plates peak at their facet slope
+* limit rather than at 4*pi*A^2/lambda^2.
+*
+* Azimuth 0 looks from -z, where the example scenes put the radar, and grows toward +x; elevation is
+* the angle above the horizontal plane (y up). Aspects run in parallel, one job each.
+*/
+
+#include "camera.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*Unit direction from the target toward a radar at the given azimuth and elevation, in degrees*/
+inline vec3 rcs_direction(double azimuth, double elevation) {
+	double az = degrees_to_radians(azimuth), el = degrees_to_radians(elevation);
+	return vec3(std::sin(az) * std::cos(el), std::sin(el), -std::cos(az) * std::cos(el));
+}
+
+/*Angles from first to last (inclusive) in steps of step; a single angle when step is not positive*/
+inline std::vector<double> rcs_angles(const vec3& range) {
+	std::vector<double> angles;
+	double first = range.x(), last = range.y(), step = range.z();
+	if (step <= 0 || last < first)
+		return { first };
+	for (int k = 0; first + k * step <= last + 1e-9; k++)
+		angles.push_back(first + k * step);
+	return angles;
+}
+
+/*
+RCS of `world` seen from unit direction d, per band of the camera's frame (one entry unless multi_band).
+Rays start outside the bounding sphere and travel along -d; each bounce adds its facet scattering
+toward d, weighted by the mirror reflectance so far, times the footprint of its ray tube.
+*/
+inline std::vector<double> rcs_at(const camera& cam, const hittable& world, const vec3& d) {
+	aabb box = world.bounding_box();
+	point3 center = box.get_center();
+	double radius = 0.5 * vec3(box.x.size(), box.y.size(), box.z.size()).length();
+	vec3 a = horizontal_field(-d, vec3(0, 1, 0), vec3(1, 0, 0));
+	vec3 b = cross(d, a);
+	double cell = 2 * radius / cam.rcs_rays;
+
+	int bands = cam.multi_band ? BAND_COUNT : 1;
+	std::vector<double> sigma(bands, 0.0);
+	facet_params f;
+	color diffuse[BAND_COUNT], specular[BAND_COUNT], mirror[BAND_COUNT], throughput[BAND_COUNT];
+
+	for (int g_j = 0; g_j < cam.rcs_rays; g_j++) {
+		for (int g_i = 0; g_i < cam.rcs_rays; g_i++) {
+			point3 origin = center + 2 * radius * d
+				+ ((g_i + 0.5) * cell - radius) * a + ((g_j + 0.5) * cell - radius) * b;
+			ray r(origin, -d);
+			for (int k = 0; k < BAND_COUNT; k++)
+				throughput[k] = color(1, 1, 1);
+
+			for (int bounce = 0; bounce <= cam.sbr_bounces; bounce++) {
+				hit_record rec;
+				thread_stats.rays++;
+				if (!world.hit(r, interval(0.001, infinity), rec))
+					break;
+
+				// The incoming wave already came along d, so only later bounces need a line of sight back
+				vec3 in = -unit_vector(r.direction());
+				double cos_i = dot(rec.normal, in);
+				hit_record blocker;
+				bool visible = dot(rec.normal, d) > 0 && cos_i > 0
+					&& (bounce == 0 || (thread_stats.rays++, !world.hit(ray(rec.p, d, 0.0), interval(0.001, infinity), blocker)));
+				rec.mat->facet(rec, f);
+				if (visible) {
+					f.scattering(rec.normal, in, d, diffuse, specular);
+					double footprint = cell * cell / cos_i;
+					for (int k = 0; k < bands; k++) {
+						int band = cam.multi_band ? k : int(cam.band);
+						color c = throughput[band] * (diffuse[band] + specular[band]);
+						sigma[k] += footprint * (c.x() + c.y() + c.z()) / 3.0;
+					}
+				}
+
+				rec.mat->mirror_weights(rec, mirror);
+				bool reflects = false;
+				for (int k = 0; k < BAND_COUNT; k++) {
+					throughput[k] = throughput[k] * mirror[k];
+					reflects = reflects || throughput[k].length_squared() > 0;
+				}
+				if (!reflects)
+					break;
+				r = ray(rec.p, reflect(unit_vector(r.direction()), rec.normal), 0.0);
+			}
+		}
+	}
+	return sigma;
+}
+
+/*
+Sweeps the camera's rcs_azimuth x rcs_elevation aspects over `world` on cam.threads workers, writing
+<stem>.csv, one row per aspect with each band's RCS in m^2 and dBsm, and <stem>_polar.ppm, RCS in dB
+against azimuth with one curve per elevation and rings every 10 dB.
+*/
+inline void run_rcs_sweep(const camera& cam, const hittable& world) {
+	trace_scope sweep_span("rcs_sweep", "render");
+	std::vector<double> azimuths = rcs_angles(cam.rcs_azimuth);
+	std::vector<double> elevations = rcs_angles(cam.rcs_elevation);
+	size_t aspects = azimuths.size() * elevations.size();
+	std::vector<std::vector<double>> sigma(aspects);
+
+	auto start = std::chrono::steady_clock::now();
+	parallel_for(aspects, cam.threads, [&](size_t job, int) {
+		shading_band = cam.multi_band ? BAND_COUNT : cam.band;
+		sigma[job] = rcs_at(cam, world, rcs_direction(azimuths[job % azimuths.size()], elevations[job / azimuths.size()]));
+	});
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::string stem = cam.output_path.empty() ? "rcs" : cam.output_path.substr(0, cam.output_path.rfind(".ppm"));
+	int bands = cam.multi_band ? BAND_COUNT : 1;
+	auto band_suffix = [&](int k) { return cam.multi_band ? std::string("_") + band_name(SPECTRUM(k)) : std::string(); };
+	auto dbsm = [](double s) { return s > 0 ? 10 * std::log10(s) : -300.0; };
+
+	std::ofstream csv(stem + ".csv");
+	if (!csv) {
+		std::cerr << "Cannot write RCS sweep " << stem << ".csv" << std::endl;
+		exit(-1);
+	}
+	csv << "azimuth_deg,elevation_deg";
+	for (int k = 0; k < bands; k++)
+		csv << ",rcs_m2" << band_suffix(k) << ",rcs_dbsm" << band_suffix(k);
+	csv << '\n';
+	double peak = 0.0;
+	for (size_t job = 0; job < aspects; job++) {
+		csv << azimuths[job % azimuths.size()] << ',' << elevations[job / azimuths.size()];
+		for (int k = 0; k < bands; k++) {
+			csv << ',' << sigma[job][k] << ',' << dbsm(sigma[job][k]);
+			peak = std::max(peak, sigma[job][k]);
+		}
+		csv << '\n';
+	}
+
+	// Polar plot of the first band: radius from 50 dB below the peak at the center to the peak at the rim
+	const int size = 512;
+	const double span = 50.0;
+	std::vector<color> plot(size_t(size) * size, color(0, 0, 0));
+	auto plot_point = [&](double azimuth, double level, const color& c) {
+		double rho = std::clamp(level, 0.0, 1.0) * (size / 2 - 8);
+		double az = degrees_to_radians(azimuth);
+		int x = int(size / 2 + rho * std::sin(az)), y = int(size / 2 - rho * std::cos(az));
+		if (x >= 0 && x < size && y >= 0 && y < size)
+			plot[size_t(y) * size + x] = c;
+	};
+	for (double ring = 0; ring <= span; ring += 10)
+		for (int t = 0; t < 2048; t++)
+			plot_point(t * 360.0 / 2048, 1 - ring / span, color(0.1, 0.1, 0.1));
+	for (size_t e = 0; e < elevations.size(); e++) {
+		double hue = elevations.size() > 1 ? double(e) / (elevations.size() - 1) : 0.0;
+		color c(1 - hue, 0.6, hue);
+		for (size_t i = 0; i < azimuths.size(); i++) {
+			// Join each azimuth to the next, and the last to the first when the sweep closes the circle
+			size_t next = i + 1;
+			double a1 = next < azimuths.size() ? azimuths[next] : azimuths.front() + 360.0;
+			if (next == azimuths.size() && (azimuths.size() < 2 || a1 - azimuths[i] > 1.5 * (azimuths[1] - azimuths[0])))
+				a1 = azimuths[i];
+			next %= azimuths.size();
+			double l0 = 1 - (dbsm(peak) - dbsm(sigma[e * azimuths.size() + i][0])) / span;
+			double l1 = 1 - (dbsm(peak) - dbsm(sigma[e * azimuths.size() + next][0])) / span;
+			for (int t = 0; t <= 64; t++)
+				plot_point(azimuths[i] + (a1 - azimuths[i]) * t / 64.0, l0 + (l1 - l0) * t / 64.0, c);
+		}
+	}
+
+	std::ofstream img(stem + "_polar.ppm");
+	if (!img) {
+		std::cerr << "Cannot write image " << stem << "_polar.ppm" << std::endl;
+		exit(-1);
+	}
+	img << "P3\n" << size << ' ' << size << "\n255\n";
+	for (const color& c : plot)
+		write_color(img, c * c);	// write_color takes the square root
+
+	std::clog << "RCS sweep of " << aspects << " aspects written to " << stem << ".csv and " << stem << "_polar.ppm ("
+		<< seconds << " s, peak " << dbsm(peak) << " dBsm)\n";
+}
+
+#endif // RCS_H
@@ -0,0 +1,140 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+/*
+* Traversal counters and the optional per-pixel cost map written next to a render.
+*/
+
+#include "common.h"
+#include "color.h"
+#include "interval.h"
+
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*Counts work done by the calling thread. Snapshot before and after a pixel to get its cost.*/
+struct render_stats {
+	uint64_t rays = 0;			// Rays traced through the scene by an integrator
+	uint64_t bvh_nodes = 0;		// bvh_node::hit calls
+	uint64_t prim_tests = 0;	// Primitive intersection tests (triangle, quad, sphere)
+
+	// Triangle and quad test outcomes
+	uint64_t tri_hits = 0;
+	uint64_t quad_hits = 0;
+	uint64_t tri_aabb_hits = 0;
+	uint64_t tri_parallel = 0;
+	uint64_t tri_intersection_behind = 0;
+	uint64_t tri_barycentric = 0;
+	uint64_t tri_beyond = 0;
+
+	render_stats& operator+=(const render_stats& s) {
+		rays += s.rays;
+		bvh_nodes += s.bvh_nodes;
+		prim_tests += s.prim_tests;
+		tri_hits += s.tri_hits;
+		quad_hits += s.quad_hits;
+		tri_aabb_hits += s.tri_aabb_hits;
+		tri_parallel += s.tri_parallel;
+		tri_intersection_behind += s.tri_intersection_behind;
+		tri_barycentric += s.tri_barycentric;
+		tri_beyond += s.tri_beyond;
+		return *this;
+	}
+
+	render_stats operator-(const render_stats& s) const {
+		render_stats d;
+		d.rays = rays - s.rays;
+		d.bvh_nodes = bvh_nodes - s.bvh_nodes;
+		d.prim_tests = prim_tests - s.prim_tests;
+		d.tri_hits = tri_hits - s.tri_hits;
+		d.quad_hits = quad_hits - s.quad_hits;
+		d.tri_aabb_hits = tri_aabb_hits - s.tri_aabb_hits;
+		d.tri_parallel = tri_parallel - s.tri_parallel;
+		d.tri_intersection_behind = tri_intersection_behind - s.tri_intersection_behind;
+		d.tri_barycentric = tri_barycentric - s.tri_barycentric;
+		d.tri_beyond = tri_beyond - s.tri_beyond;
+		return d;
+	}
+
+	void print(std::ostream& out) const {
+		out << "Rays: " << rays << "\n";
+		out << "Triangle hits: " << tri_hits << "\n";
+		out << "Quad hits: " << quad_hits << "\n";
+		out << "Tri bbox hits: " << tri_aabb_hits << "\n";
+		out << "Tri parallel: " << tri_parallel << "\n";
+		out << "Tri intersection beyond: " << tri_intersection_behind << "\n";
+		out << "Tri barycentric: " << tri_barycentric << "\n";
+		out << "Tri beyond: " << tri_beyond << "\n";
+	}
+};
+
+inline thread_local render_stats thread_stats;
+
+/*Per-pixel BVH nodes visited, primitives tested and wall-clock nanoseconds*/
+class cost_map {
+public:
+	static const int channels = 3;
+
+	cost_map() {}
+	cost_map(int width, int height) : width(width), height(height), data(size_t(width) * height * channels, 0.0f) {}
+
+	bool empty() const { return data.empty(); }
+
+	void record(int i, int j, uint64_t nodes, uint64_t prims, double nanoseconds) {
+		float* px = &data[(size_t(j) * width + i) * channels];
+		px[0] = float(nodes);
+		px[1] = float(prims);
+		px[2] = float(nanoseconds);
+	}
+
+	/*
+	Writes <prefix>.ppm, a false-color image of the time per pixel on a log scale, and <prefix>.f32,
+	the raw buffer as row-major float32 triplets (nodes, primitives, nanoseconds) in native byte order.
+	*/
+	void write(const std::string& prefix) const {
+		std::ofstream raw(prefix + ".f32", std::ios::binary);
+		raw.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size() * sizeof(float)));
+
+		double log_max = 0.0;
+		double total_ns = 0.0;
+		for (size_t p = 0; p < data.size(); p += channels) {
+			log_max = std::fmax(log_max, std::log1p(data[p + 2]));
+			total_ns += data[p + 2];
+		}
+
+		std::ofstream img(prefix + ".ppm");
+		img << "P3\n" << width << ' ' << height << "\n255\n";
+		for (size_t p = 0; p < data.size(); p += channels) {
+			double t = log_max > 0.0 ? std::log1p(data[p + 2]) / log_max : 0.0;
+			color c = false_color(t);
+			img << int(255.999 * c.x()) << ' ' << int(255.999 * c.y()) << ' ' << int(255.999 * c.z()) << '\n';
+		}
+
+		std::clog << "Cost map written to " << prefix << ".ppm and " << prefix << ".f32 ("
+			<< width << "x" << height << ", mean " << total_ns / (double(width) * height) << " ns/pixel)\n";
+	}
+
+private:
+	int width = 0;
+	int height = 0;
+	std::vector<float> data;
+
+	/*Maps [0, 1] to a blue-green-yellow-red ramp*/
+	static color false_color(double t) {
+		static const color ramp[] = {
+			color(0.0, 0.0, 0.2), color(0.0, 0.3, 1.0), color(0.0, 0.9, 0.6),
+			color(1.0, 1.0, 0.0), color(1.0, 0.4, 0.0), color(0.8, 0.0, 0.0)
+		};
+		const int segments = int(sizeof(ramp) / sizeof(ramp[0])) - 1;
+
+		t = interval(0.0, 1.0).clamp(t) * segments;
+		int k = std::min(int(t), segments - 1);
+		double f = t - k;
+		return (1.0 - f) * ramp[k] + f * ramp[k + 1];
+	}
+};
+
+#endif // RENDER_STATS_H
@@ -0,0 +1,165 @@
+#ifndef ROUGHNESS_DB_H
+#define ROUGHNESS_DB_H
+
+/*
+* RMS surface heights by .mtl material name, loaded from a text file (data/roughness.txt) so new models
+* need no rebuild. A database is immutable once loaded; reloading builds a new one, and material tables
+* compare old and new heights to re-convert only what changed (see material_table::set_database).
+*/
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class roughness_db {
+public:
+	/*Parses a database file. Returns nullptr and describes the problem in `error` on failure.*/
+	static std::shared_ptr<const roughness_db> load(const std::string& path, std::string& error) {
+		std::ifstream in(path);
+		if (!in) {
+			error = path + ": cannot open roughness database";
+			return nullptr;
+		}
+
+		auto db = std::make_shared<roughness_db>();
+		db->source = path;
+		std::string line;
+		int line_number = 0;
+		while (std::getline(in, line)) {
+			line_number++;
+			std::istringstream words(line.substr(0, line.find('#')));
+			std::string name, word;
+			if (!(words >> name))
+				continue;
+
+			entry e;
+			std::string where = path + ":" + std::to_string(line_number) + ": ";
+			if (!(words >> word) || !parse_height(word, e.rms)) {
+				error = where + "expected an RMS height after '" + name + "'";
+				return nullptr;
+			}
+			while (words >> word) {
+				size_t eq = word.find('=');
+				int band = eq == std::string::npos ? -1 : band_index(word.substr(0, eq));
+				if (band < 0 || !parse_height(word.substr(eq + 1), e.band_rms[band])) {
+					error = where + "expected band=height (VISIBLE, X, C or L), got '" + word + "'";
+					return nullptr;
+				}
+			}
+			db->entries[name] = e;
+		}
+		return db;
+	}
+
+	/*The RMS height for a material in a band, or nullptr if the material isn't listed*/
+	const double* find(const std::string& name, SPECTRUM band) const {
+		auto found = entries.find(name);
+		if (found == entries.end())
+			return nullptr;
+		const entry& e = found->second;
+		return e.band_rms[band] >= 0.0 ? &e.band_rms[band] : &e.rms;
+	}
+
+	size_t size() const { return entries.size(); }
+	const std::string& path() const { return source; }
+
+private:
+	struct entry {
+		double rms = 0.0;
+		double band_rms[BAND_COUNT] = { -1.0, -1.0, -1.0, -1.0 };	// Negative when the band has no override
+	};
+
+	std::string source;
+	std::unordered_map<std::string, entry> entries;
+
+	static bool parse_height(const std::string& s, double& height) {
+		char* end = nullptr;
+		height = std::strtod(s.c_str(), &end);
+		return !s.empty() && end == s.c_str() + s.size() && height >= 0.0;
+	}
+
+	static int band_index(const std::string& name) {
+		for (int b = 0; b < BAND_COUNT; b++)
+			if (name == band_name(SPECTRUM(b)))
+				return b;
+		return -1;
+	}
+};
+
+/*
+The database used when none is given explicitly. Loaded when a material table first needs it, from
+$SAR_ROUGHNESS or else the first default path that exists (see set_default_paths); without one every
+material keeps its .mtl colors.
+*/
+class roughness_registry {
+public:
+	static std::shared_ptr<const roughness_db> current() {
+		std::lock_guard<std::mutex> lock(mutex());
+		std::shared_ptr<const roughness_db>& db = instance();
+		if (!db) {
+			const char* env = std::getenv("SAR_ROUGHNESS");
+			std::string error;
+			if (env) {
+				db = roughness_db::load(env, error);
+			}
+			else {
+				for (const std::string& path : default_paths()) {
+					if (std::ifstream(path)) {
+						db = roughness_db::load(path, error);
+						break;
+					}
+				}
+				if (!db && error.empty())
+					std::clog << "No roughness database at " << default_paths().front() << ", materials keep their .mtl colors\n";
+			}
+			if (!error.empty())
+				std::cerr << error << ", materials keep their .mtl colors" << std::endl;
+			if (db)
+				std::clog << "Loaded " << db->size() << " RMS heights from " << db->path() << "\n";
+			else
+				db = std::make_shared<roughness_db>();
+		}
+		return db;
+	}
+
+	static void set(std::shared_ptr<const roughness_db> db) {
+		std::lock_guard<std::mutex> lock(mutex());
+		instance() = std::move(db);
+	}
+
+	/*Where current() looks for the default database, in order, until one is loaded*/
+	static void set_default_paths(std::vector<std::string> paths) {
+		std::lock_guard<std::mutex> lock(mutex());
+		default_paths() = std::move(paths);
+	}
+
+	/*The file the current database came from, empty when none has been loaded*/
+	static std::string loaded_path() {
+		std::lock_guard<std::mutex> lock(mutex());
+		return instance() ? instance()->path() : std::string();
+	}
+
+private:
+	static std::mutex& mutex() {
+		static std::mutex m;
+		return m;
+	}
+
+	static std::vector<std::string>& default_paths() {
+		static std::vector<std::string> paths = { "./data/roughness.txt" };
+		return paths;
+	}
+
+	static std::shared_ptr<const roughness_db>& instance() {
+		static std::shared_ptr<const roughness_db> db;
+		return db;
+	}
+};
+
+#endif // ROUGHNESS_DB_H
@@ -0,0 +1,1076 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+/*
+* Scene descriptions: a line-based text format and a compiled binary form (.sarb) that also carries the
+* parsed .obj meshes, so batch jobs start without touching the text parser or the .obj files.
+*
+* Text format, one statement per line, '#' starts a comment:
+*
+*   band X                                      # VISIBLE, X, C, L or ALL; used to convert .mtl materials
+*   roughness_db <file>                         # RMS heights by material, see data/roughness.txt
+*   roughness <mtl name> <rms meters>           # Overrides one material's RMS height from the database
+*   output images/house.ppm                     # Optional, defaults to stdout
+*   material <name> lambertian r g b
+*   material <name> metal r g b fuzz
+*   material <name> medium r g b fuzz ratio
+*   material <name> dielectric ior
+*   material <name> diffuse_light r g b
+*   material <name> isotropic r g b
+*   sphere cx cy cz radius <material> [transform]
+*   quad Qx Qy Qz ux uy uz vx vy vz <material> [transform]
+*   box ax ay az bx by bz <material> [transform]
+*   model <file.obj> [material=<name>] [band=<band|none>] [transform]
+*   light colocated <material>                  # Emitter behind the camera, see camera::colocate_light
+*   light quad Qx Qy Qz ux uy uz vx vy vz <material>
+*   light transmitter Px Py Pz Bx By Bz beamwidth power   # Point transmitter, see transmitter.h
+*   camera key=value ...                        # Any camera setting, see apply_camera_setting()
+*   view <name> [band=<band>] key=value ...     # An extra camera, see below
+*
+* [transform] is any of scale=s or scale=x,y,z, rotate=x,y,z (degrees) and translate=x,y,z, applied in
+* that order. A model follows the band of the view rendering it unless given band=, and band=none keeps
+* the .mtl colors. Vector camera settings accept "center", the world bounding box center at ground level.
+*
+* Without view statements the scene renders one image from the camera settings. Otherwise every view
+* renders its own image, starting from the camera settings and applying its own on top; views without
+* an output setting write <name>.ppm. All views share one world and its BVHs: models reference their
+* materials through per-band tables (see material_table.h), so a batch pays for loading and building once.
+*
+* Band ALL traces every band along one path and writes one image per band (see band_material). The
+* camera settings and the radar modes they select are described in README.md, section 3.4.
+*/
+
+#include "bvh.h"
+#include "camera.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "material_table.h"
+#include "model.h"
+#include "obj_loader.h"
+#include "quad.h"
+#include "rcs.h"
+#include "roughness_db.h"
+#include "sphere.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using scene_settings = std::vector<std::pair<std::string, std::string>>;	// key=value pairs, applied in order
+
+struct scene_transform {
+	vec3 scale = vec3(1, 1, 1);
+	vec3 rotate = vec3(0, 0, 0);
+	vec3 translate = vec3(0, 0, 0);
+};
+
+struct scene_material {
+	std::string name;
+	std::string type;
+	std::vector<double> params;
+};
+
+struct scene_object {
+	std::string kind;				// sphere, quad, box or model
+	std::vector<double> params;		// Geometry, in the order of the text statement
+	std::string material;
+	std::string path;				// model only
+	std::string band;				// model only, empty for the scene band
+	scene_transform transform;
+	shared_ptr<mesh> geometry;		// model only, filled by load_scene_meshes() or a compiled scene
+};
+
+struct scene_light {
+	std::string kind;				// colocated, quad or transmitter
+	std::vector<double> params;
+	std::string material;
+};
+
+struct scene_view {
+	std::string name;
+	std::string band;				// Empty for the scene band
+	scene_settings camera_settings;
+};
+
+struct scene_desc {
+	std::string source;
+	SPECTRUM band = X;
+	bool all_bands = false;			// band ALL
+	std::string output;
+	std::vector<scene_material> materials;
+	std::vector<scene_object> objects;
+	std::vector<scene_light> lights;
+	scene_settings camera_settings;
+	std::vector<scene_view> views;
+	std::map<std::string, double> roughness;	// RMS height overrides by .mtl material name
+	std::string roughness_db_path;				// Empty for the default database, see roughness_registry
+};
+
+/*Objects and sampled lights shared by every view*/
+struct scene_world {
+	shared_ptr<hittable_list> objects;
+	hittable_list lights;
+	std::vector<shared_ptr<material_table>> tables;	// One per mesh, for models that follow the view's band
+
+	/*Builds the material tables a view in `band` (or material_table::ALL_BANDS) needs*/
+	void prepare(int band) {
+		for (const shared_ptr<material_table>& table : tables)
+			table->prepare(band);
+	}
+
+	/*Re-converts materials whose RMS height changed in a reloaded database; safe while rendering*/
+	size_t set_roughness_db(shared_ptr<const roughness_db> db) {
+		size_t rebuilt = 0;
+		for (const shared_ptr<material_table>& table : tables)
+			rebuilt += table->set_database(db);
+		return rebuilt;
+	}
+};
+
+/*A view ready to render*/
+struct view_instance {
+	std::string name;
+	camera cam;
+	hittable_list world;			// The shared objects plus this view's colocated emitters
+	hittable_list lights;
+	shared_ptr<scene_world> shared;
+};
+
+[[noreturn]] inline void scene_error(const std::string& where, const std::string& message) {
+	std::cerr << where << ": " << message << std::endl;
+	exit(-1);
+}
+
+inline bool parse_band(const std::string& name, SPECTRUM& band) {
+	static const std::map<std::string, SPECTRUM> names = { {"VISIBLE", VISIBLE}, {"X", X}, {"C", C}, {"L", L} };
+	auto found = names.find(name);
+	if (found == names.end())
+		return false;
+	band = found->second;
+	return true;
+}
+
+/*Parses a band statement or setting, where ALL selects single-pass multi-band rendering*/
+inline bool parse_scene_band(const std::string& name, SPECTRUM& band, bool& all_bands) {
+	all_bands = name == "ALL";
+	return all_bands || parse_band(name, band);
+}
+
+/*Parses "x,y,z" or a single value repeated on all axes*/
+inline bool parse_vec3(const std::string& s, vec3& v) {
+	std::stringstream in(s);
+	std::string part;
+	double c[3];
+	int n = 0;
+	while (std::getline(in, part, ',')) {
+		if (n == 3 || !parse_double(part, c[n]))
+			return false;
+		n++;
+	}
+	if (n == 1)
+		v = vec3(c[0]);
+	else if (n == 3)
+		v = vec3(c[0], c[1], c[2]);
+	else
+		return false;
+	return true;
+}
+
+/*
+Applies one camera setting. Vector values may be "center", the center of `world_box` at ground level.
+Returns false for unknown keys or malformed values.
+*/
+inline bool apply_camera_setting(camera& cam, const std::string& key, const std::string& value, const aabb& world_box) {
+	double d = 0.0;
+	vec3 v;
+	bool is_number = parse_double(value, d);
+	bool is_vector = value == "center" ? (v = world_box.get_center() * vec3(1, 0, 1), true) : parse_vec3(value, v);
+
+	if (key == "aspect_ratio" && is_number && d > 0) cam.aspect_ratio = d;
+	else if (key == "image_width" && is_number && d >= 1) cam.image_width = int(d);
+	else if (key == "samples_per_pixel" && is_number && d >= 1) cam.samples_per_pixel = int(d);
+	else if (key == "max_depth" && is_number) cam.max_depth = int(d);
+	else if (key == "background" && is_vector) cam.background = v;
+	else if (key == "vfov" && is_number) cam.vfov = d;
+	else if (key == "lookfrom" && is_vector) cam.lookfrom = v;
+	else if (key == "lookat" && is_vector) cam.lookat = v;
+	else if (key == "vup" && is_vector) cam.vup = v;
+	else if (key == "projection") {
+		static const std::map<std::string, PROJECTION> projections = {
+			{"perspective", PERSPECTIVE}, {"orthographic", ORTHOGRAPHIC}, {"ground_range", GROUND_RANGE}
+		};
+		auto found = projections.find(value);
+		if (found == projections.end()) {
+			std::cerr << "projection must be one of perspective, orthographic, ground_range" << std::endl;
+			return false;
+		}
+		cam.projection = found->second;
+	}
+	else if (key == "look_angle" && is_number) cam.look_angle = d;
+	else if (key == "swath_width" && is_number) cam.swath_width = d;
+	else if (key == "defocus_angle" && is_number) cam.defocus_angle = d;
+	else if (key == "focus_dist" && is_number) cam.focus_dist = d;
+	else if (key == "threads" && is_number) cam.threads = int(d);
+	else if (key == "tile_size" && is_number) cam.tile_size = std::max(1, int(d));
+	else if (key == "seed" && is_number) cam.seed = uint64_t(d);
+	else if (key == "progress_interval" && is_number) cam.progress_interval = d;
+	else if (key == "progress_machine_readable" && is_number) cam.progress_machine_readable = d != 0.0;
+	else if (key == "cost_map") cam.cost_map_path = value;
+	else if (key == "output") cam.output_path = value;
+	else if (key == "range_doppler" && is_number) cam.range_doppler = d != 0.0;
+	else if (key == "range_bins" && is_number) cam.range_bins = std::max(1, int(d));
+	else if (key == "azimuth_bins" && is_number) cam.azimuth_bins = std::max(1, int(d));
+	else if (key == "range_min" && is_number) cam.range_extent.min = d;
+	else if (key == "range_max" && is_number) cam.range_extent.max = d;
+	else if (key == "azimuth_min" && is_number) cam.azimuth_extent.min = d;
+	else if (key == "azimuth_max" && is_number) cam.azimuth_extent.max = d;
+	else if (key == "ground_range" && is_number) cam.ground_range = d != 0.0;
+	else if (key == "ground_height" && is_number) cam.ground_height = d;
+	else if (key == "coherent" && is_number) cam.coherent = d != 0.0;
+	else if (key == "postprocess") {
+		std::string error;
+		if (!postprocess_pipeline::parse(value, cam.postprocess, error))
+			std::cerr << error << std::endl;
+		return error.empty();
+	}
+	else if (key == "antenna") {
+		std::string error;
+		if (!antenna_pattern::parse(value, cam.antenna, error))
+			std::cerr << error << std::endl;
+		return error.empty();
+	}
+	else if (key == "sbr_rays" && is_number) cam.sbr_rays = std::max(0, int(d));
+	else if (key == "sbr_bounces" && is_number) cam.sbr_bounces = std::max(1, int(d));
+	else if (key == "facet_backscatter" && is_number) cam.facet_backscatter = d != 0.0;
+	else if (key == "rcs_sweep" && is_number) cam.rcs_sweep = d != 0.0;
+	else if (key == "rcs_azimuth" && is_vector) cam.rcs_azimuth = v;
+	else if (key == "rcs_elevation" && is_vector) cam.rcs_elevation = v;
+	else if (key == "rcs_rays" && is_number) cam.rcs_rays = std::max(1, int(d));
+	else if (key == "footprint_cull" && is_number) cam.footprint_cull = d != 0.0;
+	else if (key == "footprint_margin" && is_number) cam.footprint_margin = d;
+	else if (key == "raster_primaries" && is_number) cam.raster_primaries = d != 0.0;
+	else if (key == "packet_size" && is_number && (d == 0 || d == 4 || d == 8)) cam.packet_size = int(d);
+	else if (key == "wavefront" && is_number) cam.wavefront = d != 0.0;
+	else if (key == "phase_history" && is_number) cam.record_phase_history = d != 0.0;
+	else if (key == "pulses" && is_number) cam.pulses = std::max(1, int(d));
+	else if (key == "pulse_spacing" && is_number) cam.pulse_spacing = d;
+	else if (key == "track_start" && is_vector) cam.track_start = v;
+	else if (key == "track_end" && is_vector) cam.track_end = v;
+	else if (key == "squint" && is_number) cam.squint = d;
+	else if (key == "pulse_images" && is_number) cam.pulse_images = d != 0.0;
+	else if (key == "polarimetric" && is_number) cam.polarimetric = d != 0.0;
+	else return false;
+	return true;
+}
+
+/*Splits "key=value" tokens off a statement's trailing arguments*/
+inline std::map<std::string, std::string> parse_options(const std::vector<std::string>& tokens, size_t first, const std::string& where) {
+	std::map<std::string, std::string> options;
+	for (size_t i = first; i < tokens.size(); i++) {
+		size_t eq = tokens[i].find('=');
+		if (eq == std::string::npos || eq == 0)
+			scene_error(where, "expected key=value, got '" + tokens[i] + "'");
+		options[tokens[i].substr(0, eq)] = tokens[i].substr(eq + 1);
+	}
+	return options;
+}
+
+/*Appends the "key=value" tokens to `settings`, keeping their order*/
+inline scene_settings parse_settings(const std::vector<std::string>& tokens, size_t first, const std::string& where,
+	scene_settings settings) {
+	parse_options(tokens, first, where);	// Validates the key=value form
+	for (size_t i = first; i < tokens.size(); i++) {
+		size_t eq = tokens[i].find('=');
+		settings.push_back({ tokens[i].substr(0, eq), tokens[i].substr(eq + 1) });
+	}
+	return settings;
+}
+
+inline scene_transform parse_transform(std::map<std::string, std::string>& options, const std::string& where) {
+	scene_transform t;
+	for (auto [key, target] : { std::pair<const char*, vec3*>{"scale", &t.scale}, {"rotate", &t.rotate}, {"translate", &t.translate} }) {
+		auto found = options.find(key);
+		if (found == options.end())
+			continue;
+		if (!parse_vec3(found->second, *target))
+			scene_error(where, std::string("bad ") + key + " '" + found->second + "'");
+		options.erase(found);
+	}
+	return t;
+}
+
+/*Reads `count` numbers starting at tokens[first]*/
+inline std::vector<double> parse_numbers(const std::vector<std::string>& tokens, size_t first, size_t count, const std::string& where) {
+	if (tokens.size() < first + count)
+		scene_error(where, "'" + tokens[0] + "' expects " + std::to_string(count) + " numbers");
+	std::vector<double> numbers(count);
+	for (size_t i = 0; i < count; i++)
+		if (!parse_double(tokens[first + i], numbers[i]))
+			scene_error(where, "expected a number, got '" + tokens[first + i] + "'");
+	return numbers;
+}
+
+inline scene_desc parse_scene(std::istream& in, const std::string& source) {
+	static const std::map<std::string, size_t> material_params = {
+		{"lambertian", 3}, {"metal", 4}, {"medium", 5}, {"dielectric", 1}, {"diffuse_light", 3}, {"isotropic", 3}
+	};
+	static const std::map<std::string, size_t> geometry_params = { {"sphere", 4}, {"quad", 9}, {"box", 6} };
+
+	scene_desc scene;
+	scene.source = source;
+
+	std::string line;
+	int line_number = 0;
+	while (std::getline(in, line)) {
+		line_number++;
+		std::string where = source + ":" + std::to_string(line_number);
+		line = line.substr(0, line.find('#'));
+
+		std::vector<std::string> tokens;
+		std::istringstream words(line);
+		for (std::string word; words >> word;)
+			tokens.push_back(word);
+		if (tokens.empty())
+			continue;
+
+		const std::string& keyword = tokens[0];
+		if (keyword == "band") {
+			if (tokens.size() != 2 || !parse_scene_band(tokens[1], scene.band, scene.all_bands))
+				scene_error(where, "band must be one of VISIBLE, X, C, L, ALL");
+		}
+		else if (keyword == "roughness_db") {
+			if (tokens.size() != 2)
+				scene_error(where, "roughness_db expects one path");
+			scene.roughness_db_path = tokens[1];
+		}
+		else if (keyword == "roughness") {
+			double rms_height;
+			if (tokens.size() != 3 || !parse_double(tokens[2], rms_height))
+				scene_error(where, "roughness expects a material name and an RMS height in meters");
+			scene.roughness[tokens[1]] = rms_height;
+		}
+		else if (keyword == "output") {
+			if (tokens.size() != 2)
+				scene_error(where, "output expects one path");
+			scene.output = tokens[1];
+		}
+		else if (keyword == "material") {
+			if (tokens.size() < 3 || !material_params.count(tokens[2]))
+				scene_error(where, "material expects a name and one of lambertian, metal, medium, dielectric, diffuse_light, isotropic");
+			size_t count = material_params.at(tokens[2]);
+			if (tokens.size() != 3 + count)
+				scene_error(where, tokens[2] + " expects " + std::to_string(count) + " numbers");
+			scene.materials.push_back({ tokens[1], tokens[2], parse_numbers(tokens, 3, count, where) });
+		}
+		else if (geometry_params.count(keyword)) {
+			size_t count = geometry_params.at(keyword);
+			scene_object object;
+			object.kind = keyword;
+			object.params = parse_numbers(tokens, 1, count, where);
+			if (tokens.size() < count + 2)
+				scene_error(where, keyword + " expects a material after its " + std::to_string(count) + " numbers");
+			object.material = tokens[count + 1];
+			auto options = parse_options(tokens, count + 2, where);
+			object.transform = parse_transform(options, where);
+			if (!options.empty())
+				scene_error(where, "unknown option '" + options.begin()->first + "'");
+			scene.objects.push_back(object);
+		}
+		else if (keyword == "model") {
+			if (tokens.size() < 2)
+				scene_error(where, "model expects an .obj path");
+			scene_object object;
+			object.kind = keyword;
+			object.path = tokens[1];
+			auto options = parse_options(tokens, 2, where);
+			object.transform = parse_transform(options, where);
+			if (options.count("material")) {
+				object.material = options["material"];
+				options.erase("material");
+			}
+			if (options.count("band")) {
+				SPECTRUM unused;
+				object.band = options["band"];
+				if (object.band != "none" && !parse_band(object.band, unused))
+					scene_error(where, "band must be one of VISIBLE, X, C, L, none");
+				options.erase("band");
+			}
+			if (!options.empty())
+				scene_error(where, "unknown option '" + options.begin()->first + "'");
+			scene.objects.push_back(object);
+		}
+		else if (keyword == "light") {
+			if (tokens.size() == 3 && tokens[1] == "colocated")
+				scene.lights.push_back({ "colocated", {}, tokens[2] });
+			else if (tokens.size() == 12 && tokens[1] == "quad")
+				scene.lights.push_back({ "quad", parse_numbers(tokens, 2, 9, where), tokens[11] });
+			else if (tokens.size() == 10 && tokens[1] == "transmitter")
+				scene.lights.push_back({ "transmitter", parse_numbers(tokens, 2, 8, where), "" });
+			else
+				scene_error(where, "light expects 'colocated <material>', 'quad Q u v <material>' or 'transmitter P boresight beamwidth power'");
+		}
+		else if (keyword == "camera") {
+			scene.camera_settings = parse_settings(tokens, 1, where, scene.camera_settings);
+		}
+		else if (keyword == "view") {
+			if (tokens.size() < 2 || tokens[1].find('=') != std::string::npos)
+				scene_error(where, "view expects a name");
+			for (const scene_view& v : scene.views)
+				if (v.name == tokens[1])
+					scene_error(where, "duplicate view '" + tokens[1] + "'");
+
+			scene_view view;
+			view.name = tokens[1];
+			for (const auto& [key, value] : parse_settings(tokens, 2, where, {})) {
+				SPECTRUM unused;
+				bool all_bands;
+				if (key != "band")
+					view.camera_settings.push_back({ key, value });
+				else if (parse_scene_band(value, unused, all_bands))
+					view.band = value;
+				else
+					scene_error(where, "band must be one of VISIBLE, X, C, L, ALL");
+			}
+			scene.views.push_back(view);
+		}
+		else {
+			scene_error(where, "unknown statement '" + keyword + "'");
+		}
+	}
+	return scene;
+}
+
+inline scene_desc parse_scene_file(const std::string& path) {
+	std::ifstream in(path);
+	if (!in)
+		scene_error(path, "cannot open scene file");
+	return parse_scene(in, path);
+}
+
+/*Parses the .obj file of every model that doesn't carry geometry yet; a file used twice is parsed once*/
+inline void load_scene_meshes(scene_desc& scene) {
+	std::map<std::string, shared_ptr<mesh>> loaded;
+	for (scene_object& object : scene.objects) {
+		if (object.kind != "model" || object.geometry)
+			continue;
+		shared_ptr<mesh>& cached = loaded[object.path];
+		if (!cached)
+			cached = make_shared<mesh>(load_mesh(object.path));
+		object.geometry = cached;
+	}
+}
+
+inline shared_ptr<material> make_scene_material(const scene_material& m) {
+	const std::vector<double>& p = m.params;
+	if (m.type == "lambertian") return make_shared<lambertian>(color(p[0], p[1], p[2]));
+	if (m.type == "metal") return make_shared<metal>(color(p[0], p[1], p[2]), p[3]);
+	if (m.type == "medium") return make_shared<medium>(make_shared<solid_color>(color(p[0], p[1], p[2])), make_shared<solid_color>(color(p[3])), p[4]);
+	if (m.type == "dielectric") return make_shared<dielectric>(p[0]);
+	if (m.type == "diffuse_light") return make_shared<diffuse_light>(color(p[0], p[1], p[2]));
+	return make_shared<isotropic>(color(p[0], p[1], p[2]));
+}
+
+inline shared_ptr<hittable> apply_transform(shared_ptr<hittable> object, const scene_transform& t) {
+	if (t.scale.x() != 1.0 || t.scale.y() != 1.0 || t.scale.z() != 1.0)
+		object = make_shared<scale>(object, t.scale);
+	if (!t.rotate.near_zero())
+		object = make_shared<rotate_xyz>(object, t.rotate.x(), t.rotate.y(), t.rotate.z());
+	if (!t.translate.near_zero())
+		object = make_shared<translate>(object, t.translate);
+	return object;
+}
+
+inline shared_ptr<material> find_scene_material(const std::map<std::string, shared_ptr<material>>& materials, const std::string& name,
+	const scene_desc& scene, const std::string& context) {
+	auto found = materials.find(name);
+	if (found == materials.end())
+		scene_error(scene.source, context + " uses undefined material '" + name + "'");
+	return found->second;
+}
+
+/*A sphere, quad or box object, before its transform*/
+inline shared_ptr<hittable> make_scene_shape(const scene_object& object, shared_ptr<material> mat) {
+	const std::vector<double>& p = object.params;
+	if (object.kind == "sphere") return make_shared<sphere>(point3(p[0], p[1], p[2]), p[3], mat);
+	if (object.kind == "quad") return make_shared<quad>(point3(p[0], p[1], p[2]), vec3(p[3], p[4], p[5]), vec3(p[6], p[7], p[8]), mat);
+	return box(point3(p[0], p[1], p[2]), point3(p[3], p[4], p[5]), mat);
+}
+
+/*Stands in for an object that only needs its bounds: never hit, and built without any geometry*/
+class bounds_proxy : public hittable {
+public:
+	bounds_proxy(const aabb& box) : bbox(box) {}
+	bool hit(const ray&, interval, hit_record&) const override { return false; }
+	aabb bounding_box() const override { return bbox; }
+private:
+	aabb bbox;
+};
+
+/*Bounds of a model's vertices before its transform*/
+inline aabb mesh_bounds(const mesh& m) {
+	aabb box = aabb::empty;
+	for (size_t i = 0; i + 2 < m.positions.size(); i += 3)
+		box = aabb(box, aabb(m.position(uint32_t(i / 3)), m.position(uint32_t(i / 3))));
+	return box;
+}
+
+/*Bounds of everything build_world would build, without building any model*/
+inline aabb scene_bounds(const scene_desc& scene) {
+	aabb box = aabb::empty;
+	for (const scene_object& object : scene.objects) {
+		shared_ptr<hittable> h = object.kind != "model" ? make_scene_shape(object, nullptr)
+			: make_shared<bounds_proxy>(object.geometry ? mesh_bounds(*object.geometry) : aabb::empty);
+		box = aabb(box, apply_transform(h, object.transform)->bounding_box());
+	}
+	for (const scene_light& light : scene.lights) {
+		const std::vector<double>& p = light.params;
+		if (light.kind == "quad")
+			box = aabb(box, quad(point3(p[0], p[1], p[2]), vec3(p[3], p[4], p[5]), vec3(p[6], p[7], p[8]), nullptr).bounding_box());
+	}
+	return box;
+}
+
+/*Maps points of a model to the world the way apply_transform places the model*/
+class scene_placement {
+public:
+	scene_placement(const scene_transform& t) : t(t), rotation(make_shared<bounds_proxy>(aabb::empty), t.rotate.x(), t.rotate.y(), t.rotate.z()) {}
+
+	point3 operator()(const point3& p) const {
+		point3 q = p * t.scale;
+		if (!t.rotate.near_zero())
+			q = rotation.rotated(q);
+		return q + t.translate;
+	}
+
+private:
+	scene_transform t;
+	rotate_xyz rotation;
+};
+
+/*
+Builds the objects and quad lights. Models must already have their meshes (see load_scene_meshes); no
+material table is prepared yet, see scene_world::prepare. With a footprint, model triangles whose world
+bounds it does not touch are left out, and the savings are reported.
+*/
+inline shared_ptr<scene_world> build_world(const scene_desc& scene, const footprint* cull = nullptr) {
+	trace_scope build_span("build_world", "build");
+	auto start = std::chrono::steady_clock::now();
+	auto world = make_shared<scene_world>();
+	world->objects = make_shared<hittable_list>();
+	std::map<const mesh*, shared_ptr<material_table>> tables;
+	size_t faces = 0, kept = 0;
+
+	std::map<std::string, shared_ptr<material>> materials;
+	for (const scene_material& m : scene.materials)
+		materials[m.name] = make_scene_material(m);
+
+	for (const scene_object& object : scene.objects) {
+		shared_ptr<hittable> h;
+
+		if (object.kind != "model") {
+			h = make_scene_shape(object, find_scene_material(materials, object.material, scene, object.kind));
+		}
+		else {
+			if (!object.geometry)
+				scene_error(scene.source, "model '" + object.path + "' has no mesh loaded");
+			shared_ptr<material> fallback = object.material.empty()
+				? make_shared<lambertian>(color(.73, .73, .73))
+				: find_scene_material(materials, object.material, scene, "model " + object.path);
+
+			face_filter keep;
+			if (cull) {
+				keep = [&, place = scene_placement(object.transform)](const point3& a, const point3& b, const point3& c) {
+					point3 wa = place(a), wb = place(b), wc = place(c);
+					bool touched = cull->touches(aabb(aabb(wa, wb), aabb(wc, wc)));
+					faces++;
+					kept += touched;
+					return touched;
+				};
+			}
+
+			if (object.band.empty()) {
+				shared_ptr<material_table>& table = tables[object.geometry.get()];
+				if (!table) {
+					table = make_shared<material_table>(object.geometry->materials, roughness_registry::current());
+					for (const auto& [name, rms_height] : scene.roughness)
+						table->set_rms(name, rms_height);
+					world->tables.push_back(table);
+				}
+				h = build_model(*object.geometry, table->slots(), fallback, object.path, keep);
+			}
+			else {
+				SPECTRUM band;
+				double wavelength = parse_band(object.band, band) ? SPECTRAL_MAP.find(band)->second : 0.0;
+				h = build_model(*object.geometry, fallback, wavelength, object.path, keep);
+			}
+		}
+		world->objects->add(apply_transform(h, object.transform));
+	}
+
+	for (const scene_light& light : scene.lights) {
+		if (light.kind != "quad")
+			continue;
+		const std::vector<double>& p = light.params;
+		point3 Q(p[0], p[1], p[2]);
+		vec3 u(p[3], p[4], p[5]), v(p[6], p[7], p[8]);
+		world->objects->add(make_shared<quad>(Q, u, v, find_scene_material(materials, light.material, scene, "light")));
+		world->lights.add(make_shared<quad>(Q, u, v, shared_ptr<material>()));
+	}
+
+	if (cull) {
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		double saved = double(faces - kept) * (sizeof(triangle) + sizeof(bvh_node) + 2 * sizeof(shared_ptr<hittable>)) / (1024.0 * 1024.0);
+		std::clog << "Footprint culling kept " << kept << " of " << faces << " triangles ("
+			<< (faces ? 100.0 * kept / faces : 100.0) << "%), built in " << seconds << " s; skipped about " << saved
+			<< " MB of triangles and BVH nodes\n";
+	}
+	return world;
+}
+
+/*
+Builds every view of the scene, or a single view from the camera settings if it has none. The world is
+built once and shared. `overrides` are applied last, on top of each view's settings. When every view
+asks for footprint_cull, cameras are set up against the bounds of the whole scene first and the world is
+built from what their illuminated volumes reach.
+*/
+inline std::vector<view_instance> build_views(const scene_desc& scene, const scene_settings& overrides = {}) {
+	std::vector<scene_view> views = scene.views;
+	if (views.empty())
+		views.push_back(scene_view{ "default", "", {} });
+
+	std::map<std::string, shared_ptr<material>> materials;
+	for (const scene_material& m : scene.materials)
+		materials[m.name] = make_scene_material(m);
+
+	// The last layer setting footprint_cull decides for each view
+	bool cull = true;
+	for (const scene_view& view : views) {
+		bool view_culls = false;
+		const scene_settings* layers[] = { &scene.camera_settings, &view.camera_settings, &overrides };
+		for (const scene_settings* settings : layers)
+			for (const auto& [key, value] : *settings)
+				if (key == "footprint_cull") {
+					double d = 0.0;
+					view_culls = parse_double(value, d) && d != 0.0;
+				}
+		cull = cull && view_culls;
+	}
+
+	shared_ptr<scene_world> world = cull ? nullptr : build_world(scene);
+	aabb world_box = cull ? scene_bounds(scene) : world->objects->bounding_box();
+	std::vector<view_instance> instances(views.size());
+	for (size_t i = 0; i < views.size(); i++) {
+		view_instance& instance = instances[i];
+		instance.name = views[i].name;
+
+		SPECTRUM band = scene.band;
+		bool all_bands = scene.all_bands;
+		if (!views[i].band.empty())
+			parse_scene_band(views[i].band, band, all_bands);
+		instance.cam.band = band;
+		instance.cam.multi_band = all_bands;
+
+		const scene_settings* layers[] = { &scene.camera_settings, &views[i].camera_settings, &overrides };
+		for (const scene_settings* settings : layers)
+			for (const auto& [key, value] : *settings)
+				if (!apply_camera_setting(instance.cam, key, value, world_box))
+					scene_error(scene.source, "bad camera setting " + key + "=" + value);
+		if (instance.cam.output_path.empty())
+			instance.cam.output_path = scene.views.empty() ? scene.output : instance.name + ".ppm";
+
+		for (const scene_light& light : scene.lights) {
+			if (light.kind != "transmitter")
+				continue;
+			const std::vector<double>& p = light.params;
+			instance.cam.transmitters.push_back(transmitter(point3(p[0], p[1], p[2]), vec3(p[3], p[4], p[5]), p[6], p[7]));
+		}
+
+		instance.cam.initialize();
+		instance.cam.fit_projection(world_box);
+		if (instance.cam.range_doppler || instance.cam.record_phase_history)
+			instance.cam.fit_range_doppler(world_box);
+	}
+
+	if (cull) {
+		// Sweeps see the model from every side, so one of them keeps everything
+		footprint lit;
+		bool sweeps = false;
+		double size = vec3(world_box.x.size(), world_box.y.size(), world_box.z.size()).length();
+		for (const view_instance& instance : instances) {
+			sweeps = sweeps || instance.cam.rcs_sweep;
+			lit.add(instance.cam.illuminated_volume(), instance.cam.footprint_margin < 0 ? 0.1 * size : instance.cam.footprint_margin);
+		}
+		if (sweeps)
+			std::clog << scene.source << ": footprint_cull ignored, a view sweeps RCS over all aspects\n";
+		world = build_world(scene, sweeps ? nullptr : &lit);
+	}
+
+	for (view_instance& instance : instances) {
+		world->prepare(instance.cam.multi_band ? material_table::ALL_BANDS : int(instance.cam.band));
+		instance.shared = world;
+		instance.world.add(world->objects);
+		instance.lights = world->lights;
+
+		for (const scene_light& light : scene.lights)
+			if (light.kind == "colocated")
+				instance.cam.colocate_light(instance.world, instance.lights, find_scene_material(materials, light.material, scene, "light"));
+
+		if (instance.lights.objects.empty() && instance.cam.transmitters.empty() && !instance.cam.rcs_sweep)
+			std::clog << scene.source << ": warning, view " << instance.name << " has no lights to sample\n";
+	}
+	return instances;
+}
+
+/*
+Renders all views through one tile queue; render settings (threads, progress) come from the first view.
+Views with rcs_sweep set run their sweep instead, against the shared objects without colocated emitters.
+*/
+inline void render_scene(std::vector<view_instance>& views) {
+	std::vector<camera::render_view> jobs;
+	for (view_instance& view : views) {
+		if (view.cam.rcs_sweep)
+			run_rcs_sweep(view.cam, *view.shared->objects);
+		else
+			jobs.push_back(camera::render_view{ &view.cam, &view.world, &view.lights });
+	}
+	if (jobs.empty())
+		return;
+	const camera& first = *jobs.front().cam;
+	camera::render_views(jobs, first.threads, first.progress_machine_readable, first.progress_interval);
+}
+
+// Compiled scenes
+
+const char scene_magic[8] = { 'S', 'A', 'R', 'S', 'C', 'E', 'N', 'E' };
+const uint32_t scene_version = 6;
+
+inline bool is_compiled_scene(const std::string& path) {
+	std::ifstream in(path, std::ios::binary);
+	char magic[sizeof(scene_magic)] = {};
+	in.read(magic, sizeof(magic));
+	return in && std::memcmp(magic, scene_magic, sizeof(magic)) == 0;
+}
+
+class scene_writer {
+public:
+	scene_writer(std::ostream& out) : out(out) {}
+
+	template <typename T> void pod(const T& value) { out.write(reinterpret_cast<const char*>(&value), sizeof(T)); }
+
+	template <typename T> void array(const std::vector<T>& values) {
+		pod(uint64_t(values.size()));
+		out.write(reinterpret_cast<const char*>(values.data()), std::streamsize(values.size() * sizeof(T)));
+	}
+
+	void string(const std::string& s) {
+		pod(uint64_t(s.size()));
+		out.write(s.data(), std::streamsize(s.size()));
+	}
+
+	void vector(const vec3& v) { pod(v.x()); pod(v.y()); pod(v.z()); }
+
+	void triple(const tinyobj::real_t* c) { pod(double(c[0])); pod(double(c[1])); pod(double(c[2])); }
+
+private:
+	std::ostream& out;
+};
+
+class scene_reader {
+public:
+	scene_reader(std::istream& in, const std::string& source) : in(in), source(source) {}
+
+	template <typename T> T pod() {
+		T value;
+		in.read(reinterpret_cast<char*>(&value), sizeof(T));
+		check();
+		return value;
+	}
+
+	template <typename T> std::vector<T> array() {
+		std::vector<T> values(size_t(pod<uint64_t>()));
+		in.read(reinterpret_cast<char*>(values.data()), std::streamsize(values.size() * sizeof(T)));
+		check();
+		return values;
+	}
+
+	std::string string() {
+		std::string s(size_t(pod<uint64_t>()), '\0');
+		in.read(s.data(), std::streamsize(s.size()));
+		check();
+		return s;
+	}
+
+	vec3 vector() {
+		double x = pod<double>(), y = pod<double>(), z = pod<double>();
+		return vec3(x, y, z);
+	}
+
+	void triple(tinyobj::real_t* c) {
+		for (int i = 0; i < 3; i++)
+			c[i] = tinyobj::real_t(pod<double>());
+	}
+
+private:
+	std::istream& in;
+	std::string source;
+
+	void check() {
+		if (!in)
+			scene_error(source, "truncated compiled scene");
+	}
+};
+
+inline void write_mesh(scene_writer& w, const mesh& m) {
+	w.array(m.positions);
+	w.array(m.normals);
+	w.array(m.faces);
+	w.pod(uint64_t(m.shapes.size()));
+	for (const mesh_shape& s : m.shapes) {
+		w.string(s.name);
+		w.pod(uint64_t(s.first_face));
+		w.pod(uint64_t(s.face_count));
+	}
+	// Only the .mtl fields get_mtl_mat reads
+	w.pod(uint64_t(m.materials.size()));
+	for (const tinyobj::material_t& mat : m.materials) {
+		w.string(mat.name);
+		w.triple(mat.ambient);
+		w.triple(mat.diffuse);
+		w.triple(mat.specular);
+		w.triple(mat.transmittance);
+		w.triple(mat.emission);
+		w.pod(double(mat.shininess));
+		w.pod(double(mat.ior));
+		w.pod(double(mat.dissolve));
+		w.pod(int32_t(mat.illum));
+	}
+}
+
+inline mesh read_mesh(scene_reader& r) {
+	mesh m;
+	m.positions = r.array<double>();
+	m.normals = r.array<double>();
+	m.faces = r.array<mesh_face>();
+	m.shapes.resize(size_t(r.pod<uint64_t>()));
+	for (mesh_shape& s : m.shapes) {
+		s.name = r.string();
+		s.first_face = size_t(r.pod<uint64_t>());
+		s.face_count = size_t(r.pod<uint64_t>());
+	}
+	m.materials.resize(size_t(r.pod<uint64_t>()));
+	for (tinyobj::material_t& mat : m.materials) {
+		mat.name = r.string();
+		r.triple(mat.ambient);
+		r.triple(mat.diffuse);
+		r.triple(mat.specular);
+		r.triple(mat.transmittance);
+		r.triple(mat.emission);
+		mat.shininess = tinyobj::real_t(r.pod<double>());
+		mat.ior = tinyobj::real_t(r.pod<double>());
+		mat.dissolve = tinyobj::real_t(r.pod<double>());
+		mat.illum = r.pod<int32_t>();
+	}
+	return m;
+}
+
+inline void write_settings(scene_writer& w, const scene_settings& settings) {
+	w.pod(uint64_t(settings.size()));
+	for (const auto& [key, value] : settings) {
+		w.string(key);
+		w.string(value);
+	}
+}
+
+inline scene_settings read_settings(scene_reader& r) {
+	scene_settings settings(size_t(r.pod<uint64_t>()));
+	for (auto& [key, value] : settings) {
+		key = r.string();
+		value = r.string();
+	}
+	return settings;
+}
+
+/*Writes the scene and every model's mesh. Meshes shared by several models are stored once.*/
+inline void write_compiled_scene(const scene_desc& scene, const std::string& path) {
+	std::ofstream out(path, std::ios::binary);
+	if (!out)
+		scene_error(path, "cannot write compiled scene");
+	scene_writer w(out);
+
+	out.write(scene_magic, sizeof(scene_magic));
+	w.pod(scene_version);
+	w.string(scene.source);
+	w.pod(int32_t(scene.band));
+	w.pod(uint8_t(scene.all_bands));
+	w.string(scene.output);
+
+	w.pod(uint64_t(scene.materials.size()));
+	for (const scene_material& m : scene.materials) {
+		w.string(m.name);
+		w.string(m.type);
+		w.array(m.params);
+	}
+
+	std::vector<const mesh*> meshes;
+	auto mesh_index = [&](const shared_ptr<mesh>& m) -> int64_t {
+		if (!m)
+			return -1;
+		for (size_t i = 0; i < meshes.size(); i++)
+			if (meshes[i] == m.get())
+				return int64_t(i);
+		meshes.push_back(m.get());
+		return int64_t(meshes.size() - 1);
+	};
+
+	w.pod(uint64_t(scene.objects.size()));
+	for (const scene_object& o : scene.objects) {
+		w.string(o.kind);
+		w.array(o.params);
+		w.string(o.material);
+		w.string(o.path);
+		w.string(o.band);
+		w.vector(o.transform.scale);
+		w.vector(o.transform.rotate);
+		w.vector(o.transform.translate);
+		w.pod(mesh_index(o.geometry));
+	}
+
+	w.pod(uint64_t(meshes.size()));
+	for (const mesh* m : meshes)
+		write_mesh(w, *m);
+
+	w.pod(uint64_t(scene.lights.size()));
+	for (const scene_light& l : scene.lights) {
+		w.string(l.kind);
+		w.array(l.params);
+		w.string(l.material);
+	}
+
+	write_settings(w, scene.camera_settings);
+
+	w.pod(uint64_t(scene.views.size()));
+	for (const scene_view& v : scene.views) {
+		w.string(v.name);
+		w.string(v.band);
+		write_settings(w, v.camera_settings);
+	}
+
+	w.string(scene.roughness_db_path);
+	w.pod(uint64_t(scene.roughness.size()));
+	for (const auto& [name, rms_height] : scene.roughness) {
+		w.string(name);
+		w.pod(rms_height);
+	}
+	std::clog << "Compiled scene written to " << path << "\n";
+}
+
+inline scene_desc read_compiled_scene(const std::string& path) {
+	trace_scope load_span("load_compiled_scene", "load", path);
+	std::ifstream in(path, std::ios::binary);
+	if (!in)
+		scene_error(path, "cannot open compiled scene");
+	scene_reader r(in, path);
+
+	char magic[sizeof(scene_magic)];
+	in.read(magic, sizeof(magic));
+	if (!in || std::memcmp(magic, scene_magic, sizeof(magic)) != 0)
+		scene_error(path, "not a compiled scene");
+	if (r.pod<uint32_t>() != scene_version)
+		scene_error(path, "compiled scene version mismatch, recompile it");
+
+	scene_desc scene;
+	scene.source = r.string();
+	scene.band = SPECTRUM(r.pod<int32_t>());
+	scene.all_bands = r.pod<uint8_t>() != 0;
+	scene.output = r.string();
+
+	scene.materials.resize(size_t(r.pod<uint64_t>()));
+	for (scene_material& m : scene.materials) {
+		m.name = r.string();
+		m.type = r.string();
+		m.params = r.array<double>();
+	}
+
+	std::vector<int64_t> mesh_indices;
+	scene.objects.resize(size_t(r.pod<uint64_t>()));
+	for (scene_object& o : scene.objects) {
+		o.kind = r.string();
+		o.params = r.array<double>();
+		o.material = r.string();
+		o.path = r.string();
+		o.band = r.string();
+		o.transform.scale = r.vector();
+		o.transform.rotate = r.vector();
+		o.transform.translate = r.vector();
+		mesh_indices.push_back(r.pod<int64_t>());
+	}
+
+	std::vector<shared_ptr<mesh>> meshes(size_t(r.pod<uint64_t>()));
+	for (shared_ptr<mesh>& m : meshes)
+		m = make_shared<mesh>(read_mesh(r));
+	for (size_t i = 0; i < scene.objects.size(); i++)
+		if (mesh_indices[i] >= 0)
+			scene.objects[i].geometry = meshes.at(size_t(mesh_indices[i]));
+
+	scene.lights.resize(size_t(r.pod<uint64_t>()));
+	for (scene_light& l : scene.lights) {
+		l.kind = r.string();
+		l.params = r.array<double>();
+		l.material = r.string();
+	}
+
+	scene.camera_settings = read_settings(r);
+
+	scene.views.resize(size_t(r.pod<uint64_t>()));
+	for (scene_view& v : scene.views) {
+		v.name = r.string();
+		v.band = r.string();
+		v.camera_settings = read_settings(r);
+	}
+
+	scene.roughness_db_path = r.string();
+	size_t roughness = size_t(r.pod<uint64_t>());
+	for (size_t i = 0; i < roughness; i++) {
+		std::string name = r.string();
+		scene.roughness[name] = r.pod<double>();
+	}
+	return scene;
+}
+
+/*
+Makes the scene's roughness database (or `override_path`) the current one. Returns its path, empty when
+the default database is used: it loads only once a model needs it, from data/roughness.txt next to the
+scene file, next to its directory (where the bundled scenes keep it) or in the working directory.
+*/
+inline std::string load_scene_roughness(const scene_desc& scene, const std::string& override_path = "") {
+	std::string path = override_path.empty() ? scene.roughness_db_path : override_path;
+	if (path.empty()) {
+		size_t slash = scene.source.find_last_of("/\\");
+		std::string dir = slash == std::string::npos ? "." : scene.source.substr(0, slash);
+		roughness_registry::set_default_paths({ dir + "/data/roughness.txt", dir + "/../data/roughness.txt", "./data/roughness.txt" });
+		return "";
+	}
+
+	std::string error;
+	shared_ptr<const roughness_db> db = roughness_db::load(path, error);
+	if (!db)
+		scene_error(scene.source, error);
+	std::clog << "Loaded " << db->size() << " RMS heights from " << path << "\n";
+	roughness_registry::set(db);
+	return path;
+}
+
+/*Loads a text or compiled scene, including model meshes*/
+inline scene_desc load_scene(const std::string& path) {
+	if (is_compiled_scene(path))
+		return read_compiled_scene(path);
+	scene_desc scene = parse_scene_file(path);
+	load_scene_meshes(scene);
+	return scene;
+}
+
+#endif // SCENE_H
@@ -3,6 +3,7 @@
 
 #include "hittable.h"
 #include "onb.h"
+#include "render_stats.h"
 
 //double drand48(void);
 
@@ -27,6 +28,7 @@ public:
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        thread_stats.prim_tests++;
         point3 current_center = center.at(r.time());
         vec3 oc = current_center - r.origin();
         double a = r.direction().length_squared();
@@ -0,0 +1,148 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+* Scoped trace spans exported in the Chrome trace-event format (chrome://tracing, ui.perfetto.dev).
+*
+* Recording is off until trace_recorder::get().enable() is called; a disabled trace_scope costs one
+* relaxed load. Each thread appends to its own buffer, so spans from render workers never contend.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct trace_event {
+	const char* name;
+	const char* category;
+	std::string detail;		// Shown under "args" in the viewer, may be empty
+	double start_us;
+	double duration_us;
+};
+
+class trace_recorder {
+public:
+	static trace_recorder& get() {
+		static trace_recorder recorder;
+		return recorder;
+	}
+
+	void enable() {
+		epoch = std::chrono::steady_clock::now();
+		enabled.store(true, std::memory_order_relaxed);
+	}
+
+	bool is_enabled() const { return enabled.load(std::memory_order_relaxed); }
+
+	double now_us() const {
+		return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+	}
+
+	void record(trace_event&& event) {
+		thread_buffer().events.push_back(std::move(event));
+	}
+
+	/*Writes every recorded span as a JSON trace. Call once worker threads have joined.*/
+	void write(const std::string& path) {
+		std::lock_guard<std::mutex> lock(buffers_mutex);
+		std::ofstream out(path);
+		out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+		bool first = true;
+		for (const auto& buffer : buffers) {
+			std::string thread_name = buffer->tid == 0 ? "main" : "worker " + std::to_string(buffer->tid);
+			out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+				<< ",\"args\":{\"name\":\"" << thread_name << "\"}}";
+			first = false;
+
+			for (const trace_event& e : buffer->events) {
+				out << ",\n{\"name\":\"" << e.name << "\",\"cat\":\"" << e.category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+					<< ",\"ts\":" << e.start_us << ",\"dur\":" << e.duration_us;
+				if (!e.detail.empty())
+					out << ",\"args\":{\"detail\":\"" << escape(e.detail) << "\"}";
+				out << "}";
+			}
+		}
+		out << "\n]}\n";
+		std::clog << "Trace written to " << path << "\n";
+	}
+
+private:
+	struct thread_events {
+		int tid;
+		std::vector<trace_event> events;
+	};
+
+	std::atomic<bool> enabled{ false };
+	std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	std::mutex buffers_mutex;
+	std::vector<std::unique_ptr<thread_events>> buffers;
+
+	trace_recorder() {}
+
+	/*Registers the calling thread on first use; the first thread to record becomes tid 0*/
+	thread_events& thread_buffer() {
+		thread_local thread_events* local = nullptr;
+		if (!local) {
+			std::lock_guard<std::mutex> lock(buffers_mutex);
+			buffers.push_back(std::make_unique<thread_events>());
+			buffers.back()->tid = int(buffers.size()) - 1;
+			local = buffers.back().get();
+		}
+		return *local;
+	}
+
+	static std::string escape(const std::string& s) {
+		std::string out;
+		for (char c : s) {
+			if (c == '"' || c == '\\')
+				out += '\\';
+			if (c >= 0 && c < 0x20)
+				continue;
+			out += c;
+		}
+		return out;
+	}
+};
+
+/*Records a complete ("X") event covering its own lifetime. name and category must be string literals.*/
+class trace_scope {
+public:
+	trace_scope(const char* name, const char* category) : name(name), category(category) {
+		active = trace_recorder::get().is_enabled();
+		if (active)
+			start_us = trace_recorder::get().now_us();
+	}
+
+	trace_scope(const char* name, const char* category, const std::string& detail) : trace_scope(name, category) {
+		if (active)
+			this->detail = detail;
+	}
+
+	~trace_scope() { end(); }
+
+	/*Closes the span early; later calls and the destructor do nothing*/
+	void end() {
+		if (!active)
+			return;
+		active = false;
+		trace_recorder& recorder = trace_recorder::get();
+		recorder.record(trace_event{ name, category, std::move(detail), start_us, recorder.now_us() - start_us });
+	}
+
+	trace_scope(const trace_scope&) = delete;
+	trace_scope& operator=(const trace_scope&) = delete;
+
+private:
+	const char* name;
+	const char* category;
+	std::string detail;
+	double start_us = 0.0;
+	bool active;
+};
+
+#endif // TRACE_H
@@ -0,0 +1,58 @@
+#ifndef TRANSMITTER_H
+#define TRANSMITTER_H
+
+/*
+* A point radar transmitter, for bistatic scenes where it flies apart from the receiving camera. It is not
+* part of the world: integrators connect every diffuse hit straight to it with a shadow ray (see
+* camera::sample_transmitters), so a transmitter anywhere converges as fast as the colocated emitter.
+*/
+
+#include <algorithm>
+#include <cmath>
+
+class transmitter {
+public:
+	transmitter() {}
+
+	/*
+	A transmitter at `position` radiating `power` through a Gaussian beam along `boresight`, `beamwidth`
+	degrees wide between its half power points. A beamwidth of zero radiates the same in every direction.
+	*/
+	transmitter(const point3& position, const vec3& boresight, double beamwidth, double power)
+		: position(position), boresight(unit_vector(boresight)), power(power) {
+		if (beamwidth > 0) {
+			double half = degrees_to_radians(beamwidth) / 2.0;
+			falloff = std::log(2.0) / (half * half);
+		}
+
+		// Normalize the pattern so its gain integrates to 4*pi over the sphere
+		const int steps = 2048;
+		double total = 0.0;
+		for (int k = 0; k < steps; k++) {
+			double theta = (k + 0.5) * pi / steps;
+			total += std::exp(-falloff * theta * theta) * 2.0 * pi * std::sin(theta) * pi / steps;
+		}
+		peak_gain = 4.0 * pi / total;
+	}
+
+	/*Gain toward unit direction d, relative to an isotropic radiator*/
+	double gain(const vec3& d) const {
+		if (falloff == 0.0)
+			return 1.0;
+		double theta = std::acos(std::clamp(dot(d, boresight), -1.0, 1.0));
+		return peak_gain * std::exp(-falloff * theta * theta);
+	}
+
+	/*Radiant intensity, power per steradian, toward unit direction d*/
+	double intensity(const vec3& d) const { return power / (4.0 * pi) * gain(d); }
+
+	point3 position;
+
+private:
+	vec3 boresight = vec3(0, 0, 1);
+	double power = 0.0;
+	double falloff = 0.0;		// Gaussian beam exponent per squared radian off boresight
+	double peak_gain = 1.0;
+};
+
+#endif // TRANSMITTER_H
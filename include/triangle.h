@@ -3,15 +3,9 @@
 
 #include "hittable.h"
 #include "hittable_list.h"
+#include "render_stats.h"
 #include <iostream>
 
-extern int tri_hits;
-extern int tri_aabb_hits;
-extern int tri_parallel;
-extern int tri_intersection_behind;
-extern int tri_barycentric;
-extern int tri_beyond;
-
 class triangle : public hittable {
 public:
 	triangle() {}
@@ -42,7 +36,8 @@ public:
 	}
 
 	bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-		tri_aabb_hits++;
+		thread_stats.tri_aabb_hits++;
+		thread_stats.prim_tests++;
 		// Moller Trumbore intersection
 		const float EPSILON = 1e-8;
 
@@ -58,7 +53,7 @@ public:
 		// If ray is parallel to triangle, ray misses
 		if (determinant > -EPSILON && determinant < EPSILON)
 		{
-			tri_parallel++;
+			thread_stats.tri_parallel++;
 			//print(std::clog, pvec, tvec, determinant);
 			return false;
 		}
@@ -68,7 +63,7 @@ public:
 		// Intersection is behind origin or beyond the current known intersection
 		if ((u < 0.0 && std::fabs(u) > EPSILON) || (u > 1.0 && fabs(u - 1.0) > EPSILON))
 		{
-			tri_intersection_behind++;
+			thread_stats.tri_intersection_behind++;
 			return false;
 		}
 
@@ -77,7 +72,7 @@ public:
 		// Check barycentric coordinates
 		if ((v < 0.0 && std::fabs(v) > EPSILON) || (v + u > 1.0 && std::fabs(u + v - 1.0) > EPSILON))
 		{
-			tri_barycentric++;
+			thread_stats.tri_barycentric++;
 			return false;
 		}
 
@@ -86,12 +81,12 @@ public:
 		// Intersection beyond current t
 		if (!ray_t.contains(t))
 		{
-			tri_beyond++;
+			thread_stats.tri_beyond++;
 			return false;
 		}
 
 		// Hit
-		tri_hits++;
+		thread_stats.tri_hits++;
 		rec.set_face_normal(r, normal);
 		rec.t = t;
 		rec.p = r.at(t);
@@ -137,6 +132,12 @@ public:
 		return random_in_triangle - origin;
 	}
 
+	/*triangle_uv weighs v0_uv by v1's barycentric coordinate, v1_uv by v2's and v2_uv by v0's*/
+	bool triangulate(const placement& place, std::vector<world_triangle>& out) const override {
+		out.push_back({ { place(v0), place(v1), place(v2) }, { v2_uv, v0_uv, v1_uv }, mat });
+		return true;
+	}
+
 	void print(std::ostream& out) {
 		out << "vertices: (" << v0 << ", " << v1 << ", " << v2 << ")" << '\n';
 		out << "normal: (" << vn0 << ", " << vn1 << ", " << vn2 << ")" << '\n';
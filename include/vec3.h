@@ -172,7 +172,7 @@ inline vec3 random_cosine_direction() {
 inline vec3 random_on_unit_sphere() {
     vec3 p;
     do {
-        p = 2.0 * vec3(drand48(), drand48(), drand48()) - vec3(1., 1., 1.);
+        p = 2.0 * vec3(random_double(), random_double(), random_double()) - vec3(1., 1., 1.);
     } while (p.length_squared() >= 1.0);
     return p;
 }
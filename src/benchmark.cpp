@@ -0,0 +1,356 @@
+/*
+* Benchmark suite for the acceleration structure and intersection kernels.
+*
+* Every scene and ray set is generated from a fixed seed so that two builds can be compared run for run.
+* Results are written as JSON (stdout by default, or the file given with --out).
+*
+* Usage: SAR_Benchmark [--seed N] [--out results.json] [--model path.obj ...]
+*/
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../include/common.h"
+#include "../include/bvh.h"
+#include "../include/camera.h"
+#include "../include/hittable.h"
+#include "../include/hittable_list.h"
+#include "../include/material.h"
+#include "../include/triangle.h"
+#include "../include/quad.h"
+#include "../include/sphere.h"
+#include "../include/obj_loader.h"
+
+#ifndef SAR_BUILD_TYPE
+#define SAR_BUILD_TYPE "unknown"
+#endif
+
+using bench_clock = std::chrono::steady_clock;
+
+double elapsed_ms(bench_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+struct bench_scene {
+    std::string name;
+    std::string source;             // "procedural" or the .obj path
+    shared_ptr<hittable> world;     // Accelerated scene
+    size_t primitive_count = 0;     // Primitives handed to the BVH, 0 if unknown
+    double build_ms = 0.0;          // BVH build time (includes parsing for bundled models)
+    point3 lookfrom;
+    point3 lookat;
+    point3 light;                   // Shadow ray target
+};
+
+struct ray_rates {
+    double primary = 0.0;           // Rays per second
+    double secondary = 0.0;
+    double shadow = 0.0;
+    double primary_hit_fraction = 0.0;
+};
+
+struct kernel_result {
+    std::string name;
+    double calls_per_sec = 0.0;
+    double hit_fraction = 0.0;
+};
+
+/*Builds a BVH over the given list and records the build time*/
+void build_bvh(bench_scene& scene, hittable_list& objects) {
+    scene.primitive_count = objects.objects.size();
+    auto start = bench_clock::now();
+    scene.world = make_shared<bvh_node>(objects);
+    scene.build_ms = elapsed_ms(start);
+}
+
+bench_scene triangle_soup(int count) {
+    bench_scene scene;
+    scene.name = "triangle_soup";
+    scene.source = "procedural";
+
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    hittable_list objects;
+    for (int i = 0; i < count; i++) {
+        point3 p = vec3::random(-1, 1);
+        objects.add(make_shared<triangle>(p, p + vec3::random(-.05, .05), p + vec3::random(-.05, .05), white));
+    }
+
+    build_bvh(scene, objects);
+    scene.lookfrom = point3(0, 0, -3);
+    scene.lookat = point3(0, 0, 0);
+    scene.light = point3(0, 4, -2);
+    return scene;
+}
+
+bench_scene sphere_field(int count) {
+    bench_scene scene;
+    scene.name = "sphere_field";
+    scene.source = "procedural";
+
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    hittable_list objects;
+    for (int i = 0; i < count; i++)
+        objects.add(make_shared<sphere>(vec3::random(-1, 1), random_double(.005, .04), white));
+
+    build_bvh(scene, objects);
+    scene.lookfrom = point3(0, 0, -3);
+    scene.lookat = point3(0, 0, 0);
+    scene.light = point3(0, 4, -2);
+    return scene;
+}
+
+bench_scene cornell() {
+    bench_scene scene;
+    scene.name = "cornell";
+    scene.source = "procedural";
+
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    hittable_list objects;
+    objects.add(make_shared<quad>(point3(555, 0, 0), vec3(0, 0, 555), vec3(0, 555, 0), white));
+    objects.add(make_shared<quad>(point3(0, 0, 555), vec3(0, 0, -555), vec3(0, 555, 0), white));
+    objects.add(make_shared<quad>(point3(0, 555, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
+    objects.add(make_shared<quad>(point3(0, 0, 555), vec3(555, 0, 0), vec3(0, 0, -555), white));
+    objects.add(make_shared<quad>(point3(555, 0, 555), vec3(-555, 0, 0), vec3(0, 555, 0), white));
+
+    shared_ptr<hittable> box1 = box(point3(0, 0, 0), point3(165, 330, 165), white);
+    box1 = make_shared<rotate_xyz>(box1, 0, 15, 0);
+    objects.add(make_shared<translate>(box1, vec3(265, 0, 295)));
+
+    shared_ptr<hittable> box2 = box(point3(0, 0, 0), point3(165, 165, 165), white);
+    box2 = make_shared<rotate_xyz>(box2, 0, -18, 0);
+    objects.add(make_shared<translate>(box2, vec3(130, 0, 65)));
+
+    build_bvh(scene, objects);
+    scene.lookfrom = point3(278, 278, -800);
+    scene.lookat = point3(278, 278, 0);
+    scene.light = point3(278, 554, 278);
+    return scene;
+}
+
+bench_scene bundled_model(const std::string& path) {
+    bench_scene scene;
+    scene.name = path.substr(path.find_last_of("/\\") + 1);
+    scene.source = path;
+
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    auto start = bench_clock::now();
+    scene.world = load_model_from_file(path, white, SPECTRAL_MAP.at(X));
+    scene.build_ms = elapsed_ms(start);
+
+    // Models are normalized to [-1, 1] by the loader
+    scene.lookfrom = point3(0, 1.5, -3);
+    scene.lookat = point3(0, 0, 0);
+    scene.light = point3(0, 4, -2);
+    return scene;
+}
+
+/*Traces primary, diffuse secondary and shadow rays through the scene*/
+ray_rates measure_rays(const bench_scene& scene) {
+    camera cam;
+    cam.aspect_ratio = 1.0;
+    cam.image_width = 128;
+    cam.samples_per_pixel = 4;
+    cam.vfov = 40;
+    cam.lookfrom = scene.lookfrom;
+    cam.lookat = scene.lookat;
+    cam.initialize();
+
+    std::vector<ray> primary;
+    for (int j = 0; j < cam.height(); j++)
+        for (int i = 0; i < cam.image_width; i++)
+            for (int s_j = 0; s_j < cam.samples_per_axis(); s_j++)
+                for (int s_i = 0; s_i < cam.samples_per_axis(); s_i++)
+                    primary.push_back(cam.get_ray(i, j, s_i, s_j));
+
+    ray_rates rates;
+    std::vector<hit_record> hits;
+    hits.reserve(primary.size());
+
+    auto start = bench_clock::now();
+    for (const ray& r : primary) {
+        hit_record rec;
+        if (scene.world->hit(r, interval(0.001, infinity), rec))
+            hits.push_back(rec);
+    }
+    rates.primary = primary.size() / (elapsed_ms(start) / 1000.0);
+    rates.primary_hit_fraction = double(hits.size()) / primary.size();
+
+    if (hits.empty())
+        return rates;
+
+    std::vector<ray> secondary;
+    std::vector<ray> shadow;
+    for (const hit_record& rec : hits) {
+        secondary.push_back(ray(rec.p, onb(rec.normal).transform(random_cosine_direction())));
+        shadow.push_back(ray(rec.p, scene.light - rec.p));
+    }
+
+    start = bench_clock::now();
+    for (const ray& r : secondary) {
+        hit_record rec;
+        scene.world->hit(r, interval(0.001, infinity), rec);
+    }
+    rates.secondary = secondary.size() / (elapsed_ms(start) / 1000.0);
+
+    // Shadow rays only need to reach the light, which sits at t = 1
+    start = bench_clock::now();
+    for (const ray& r : shadow) {
+        hit_record rec;
+        scene.world->hit(r, interval(0.001, 1.0 - 0.001), rec);
+    }
+    rates.shadow = shadow.size() / (elapsed_ms(start) / 1000.0);
+
+    return rates;
+}
+
+/*Generates rays from a shell around the origin aimed at random points inside the unit box*/
+std::vector<ray> kernel_rays(int count) {
+    std::vector<ray> rays;
+    for (int i = 0; i < count; i++) {
+        point3 origin = 4.0 * random_unit_vector();
+        point3 target = vec3::random(-1, 1);
+        rays.push_back(ray(origin, target - origin));
+    }
+    return rays;
+}
+
+kernel_result measure_kernel(const std::string& name, const std::vector<ray>& rays, const std::function<bool(const ray&)>& kernel) {
+    const int passes = 200;
+    long long hits = 0;
+
+    auto start = bench_clock::now();
+    for (int pass = 0; pass < passes; pass++)
+        for (const ray& r : rays)
+            hits += kernel(r);
+    double seconds = elapsed_ms(start) / 1000.0;
+
+    kernel_result result;
+    result.name = name;
+    result.calls_per_sec = double(passes) * rays.size() / seconds;
+    result.hit_fraction = double(hits) / (double(passes) * rays.size());
+    return result;
+}
+
+std::vector<kernel_result> measure_kernels() {
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    std::vector<ray> rays = kernel_rays(8192);
+
+    triangle tri(point3(-1, -1, 0), point3(1, -1, 0), point3(0, 1, 0), white);
+    quad qd(point3(-1, -1, 0), vec3(2, 0, 0), vec3(0, 2, 0), white);
+    sphere sph(point3(0, 0, 0), 1.0, white);
+    aabb box(point3(-1, -1, -1), point3(1, 1, 1));
+
+    std::vector<kernel_result> results;
+    results.push_back(measure_kernel("triangle::hit", rays, [&](const ray& r) {
+        hit_record rec;
+        return tri.hit(r, interval(0.001, infinity), rec);
+    }));
+    results.push_back(measure_kernel("quad::hit", rays, [&](const ray& r) {
+        hit_record rec;
+        return qd.hit(r, interval(0.001, infinity), rec);
+    }));
+    results.push_back(measure_kernel("sphere::hit", rays, [&](const ray& r) {
+        hit_record rec;
+        return sph.hit(r, interval(0.001, infinity), rec);
+    }));
+    results.push_back(measure_kernel("aabb::hit", rays, [&](const ray& r) {
+        return box.hit(r, interval(0.001, infinity));
+    }));
+    return results;
+}
+
+std::string json_string(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+int main(int argc, char* argv[]) {
+    unsigned int seed = 1337;
+    std::string out_path;
+    std::vector<std::string> models = { "./models/house.obj", "./models/eiffel.obj" };
+    bool default_models = true;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--seed" && i + 1 < argc)
+            seed = unsigned(std::stoul(argv[++i]));
+        else if (arg == "--out" && i + 1 < argc)
+            out_path = argv[++i];
+        else if (arg == "--model" && i + 1 < argc) {
+            if (default_models)
+                models.clear();
+            default_models = false;
+            models.push_back(argv[++i]);
+        }
+        else {
+            std::cerr << "Usage: SAR_Benchmark [--seed N] [--out results.json] [--model path.obj ...]\n";
+            return 1;
+        }
+    }
+
+    std::vector<std::function<bench_scene()>> builders = {
+        [] { return triangle_soup(100000); },
+        [] { return sphere_field(20000); },
+        [] { return cornell(); },
+    };
+    for (const std::string& path : models) {
+        if (!std::ifstream(path).good()) {
+            std::clog << "Skipping missing model '" << path << "'\n";
+            continue;
+        }
+        builders.push_back([path] { return bundled_model(path); });
+    }
+
+    std::ostringstream json;
+    json << "{\n  \"schema\": 1,\n  \"build_type\": " << json_string(SAR_BUILD_TYPE) << ",\n  \"seed\": " << seed << ",\n";
+    json << "  \"scenes\": [";
+
+    for (size_t s = 0; s < builders.size(); s++) {
+        // Reseed per scene so adding or removing a scene doesn't shift the others' rays
+        seed_random(seed + s);
+        bench_scene scene = builders[s]();
+        std::clog << "Benchmarking " << scene.name << "\n";
+        ray_rates rates = measure_rays(scene);
+
+        json << (s ? "," : "") << "\n    {\n";
+        json << "      \"name\": " << json_string(scene.name) << ",\n";
+        json << "      \"source\": " << json_string(scene.source) << ",\n";
+        json << "      \"primitives\": " << scene.primitive_count << ",\n";
+        json << "      \"bvh_build_ms\": " << scene.build_ms << ",\n";
+        json << "      \"primary_rays_per_sec\": " << rates.primary << ",\n";
+        json << "      \"primary_hit_fraction\": " << rates.primary_hit_fraction << ",\n";
+        json << "      \"secondary_rays_per_sec\": " << rates.secondary << ",\n";
+        json << "      \"shadow_rays_per_sec\": " << rates.shadow << "\n";
+        json << "    }";
+    }
+    json << "\n  ],\n  \"kernels\": [";
+
+    seed_random(seed);
+    std::vector<kernel_result> kernels = measure_kernels();
+    for (size_t k = 0; k < kernels.size(); k++) {
+        json << (k ? "," : "") << "\n    { \"name\": " << json_string(kernels[k].name)
+             << ", \"calls_per_sec\": " << kernels[k].calls_per_sec
+             << ", \"hit_fraction\": " << kernels[k].hit_fraction << " }";
+    }
+    json << "\n  ]\n}\n";
+
+    if (out_path.empty()) {
+        std::cout << json.str();
+    }
+    else {
+        std::ofstream out(out_path);
+        out << json.str();
+        std::clog << "Wrote " << out_path << "\n";
+    }
+    return 0;
+}